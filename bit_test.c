@@ -3,8 +3,23 @@
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "bitpack.h"
+#include "bitpack_track.h"
+#include "bitpack_crc.h"
+#include "bitpack_iov.h"
+#include "bitpack_column.h"
+#include "bitpack_view.h"
+#include "bitpack_scan.h"
+#include "bitpack_buf.h"
+#include "bitpack_ring.h"
+#include "bitpack_roar.h"
+#include "bitpack_file.h"
+
+// generated from bitgen_test.layout, see there to regenerate
+#define BITGEN_NO_MAIN
+#include "bitgen_test_check.h"
 
 void dump_bits(uint8_t* ptr, size_t n)
 {
@@ -312,8 +327,1408 @@ void test1()
     }
 }
 
+//
+// scatter test, compare with a sequence of set_bits calls
+//
+#define SCATTER_SIZE  509    // not a multiple of 8 to test the tail
+#define SCATTER_COUNT 200
+
+void check_scatter(int be, int n, int flags)
+{
+    uint8_t a[SCATTER_SIZE];
+    uint8_t b[SCATTER_SIZE];
+    uint32_t offs[SCATTER_COUNT];
+    uint32_t values[SCATTER_COUNT];
+    int nslots = (SCATTER_SIZE*8) / n;
+    long r;
+    int k;
+
+    for (k = 0; k < SCATTER_SIZE; k++)
+	a[k] = b[k] = random();
+    for (k = 0; k < SCATTER_COUNT; k++) {
+	// use slots when sorting, overlapping fields are unordered then
+	if (flags & SCATTER_SORT)
+	    offs[k] = (random() % nslots) * n;
+	else
+	    offs[k] = random() % (SCATTER_SIZE*8 - n + 1);
+	values[k] = random() & MAKE_MASK64(n);
+	if (be)
+	    set_bits_be(a, values[k], offs[k], n);
+	else
+	    set_bits_le(a, values[k], offs[k], n);
+    }
+#ifdef BITPACK_THREADS
+    if (flags & SCATTER_SORT) {
+	uint8_t c[SCATTER_SIZE];
+	memcpy(c, b, sizeof(c));
+	if (be)
+	    scatter_bits_be_mt(c, sizeof(c), offs, values, SCATTER_COUNT, n, 3);
+	else
+	    scatter_bits_le_mt(c, sizeof(c), offs, values, SCATTER_COUNT, n, 3);
+	if (memcmp(a, c, sizeof(a)) != 0) {
+	    fprintf(stderr, "FAIL: scatter_mt %s n=%d\n", be?"BE":"LE", n);
+	    exit(1);
+	}
+    }
+#endif
+    if (be)
+	r = scatter_bits_be(b, sizeof(b), offs, values, SCATTER_COUNT, n, flags);
+    else
+	r = scatter_bits_le(b, sizeof(b), offs, values, SCATTER_COUNT, n, flags);
+    if ((r != SCATTER_COUNT) || (memcmp(a, b, sizeof(a)) != 0)) {
+	fprintf(stderr, "FAIL: scatter %s n=%d, flags=%d\n",
+		be?"BE":"LE", n, flags);
+	dump_bits(a, sizeof(a));
+	dump_bits(b, sizeof(b));
+	exit(1);
+    }
+}
+
+void test2()
+{
+    int j, n;
+
+    for (j = 0; j < 100; j++) {
+	for (n = 1; n <= 32; n++) {
+	    check_scatter(0, n, 0);
+	    check_scatter(1, n, 0);
+	    check_scatter(0, n, SCATTER_SORT);
+	    check_scatter(1, n, SCATTER_SORT);
+	}
+    }
+}
+
+//
+// transpose and bit plane test, compare with get_bit/set_bit loops
+//
+void check_transpose(int be)
+{
+    uint8_t a[512], b[512], c[512];
+    int r, k;
+
+    for (k = 0; k < 512; k++)
+	a[k] = random();
+    // 8x8
+    if (be) transpose_8x8_be(a, b); else transpose_8x8_le(a, b);
+    for (r = 0; r < 8; r++) {
+	for (k = 0; k < 8; k++) {
+	    int x = be ? get_bit_be(a, 8*r+k) : get_bit_le(a, 8*r+k);
+	    int y = be ? get_bit_be(b, 8*k+r) : get_bit_le(b, 8*k+r);
+	    if (x != y) {
+		fprintf(stderr, "FAIL: transpose_8x8 %s\n", be?"BE":"LE");
+		exit(1);
+	    }
+	}
+    }
+    // 64x64
+    if (be) transpose_64x64_be(a, b); else transpose_64x64_le(a, b);
+    transpose64_scalar_(a, c, be);
+    for (r = 0; r < 64; r++) {
+	for (k = 0; k < 64; k++) {
+	    int x = be ? get_bit_be(a, 64*r+k) : get_bit_le(a, 64*r+k);
+	    int y = be ? get_bit_be(b, 64*k+r) : get_bit_le(b, 64*k+r);
+	    int z = be ? get_bit_be(c, 64*k+r) : get_bit_le(c, 64*k+r);
+	    if ((x != y) || (x != z)) {
+		fprintf(stderr, "FAIL: transpose_64x64 %s\n", be?"BE":"LE");
+		exit(1);
+	    }
+	}
+    }
+}
+
+void check_planes(int be, int n, int w)
+{
+    uint8_t src[4*200+8], dst[4*200+8];
+    uint8_t planes[32*BITPLANE_SIZE(200)];
+    size_t psize = BITPLANE_SIZE(n);
+    int k, j;
+
+    for (k = 0; k < (int) sizeof(src); k++)
+	src[k] = dst[k] = random();
+    if (be) bits_to_planes_be(src, n, w, planes);
+    else bits_to_planes_le(src, n, w, planes);
+    for (k = 0; k < n; k++) {
+	for (j = 0; j < w; j++) {
+	    int x = be ? get_bit_be(src, k*w+j) : get_bit_le(src, k*w+j);
+	    int y = be ? get_bit_be(planes+j*psize, k)
+		: get_bit_le(planes+j*psize, k);
+	    if (x != y) {
+		fprintf(stderr, "FAIL: bits_to_planes %s n=%d, w=%d\n",
+			be?"BE":"LE", n, w);
+		exit(1);
+	    }
+	}
+    }
+    for (k = 0; k < (int) sizeof(dst); k++)
+	dst[k] = ~src[k];
+    if (be) planes_to_bits_be(planes, n, w, dst);
+    else planes_to_bits_le(planes, n, w, dst);
+    for (k = 0; k < (int) sizeof(dst); k++) {
+	uint8_t mask = 0xff;
+	if (k == (n*w) >> 3)  // only the bits covered by the values
+	    mask = be ? ~MAKE_MASK(8 - ((n*w) & 7)) : MAKE_MASK((n*w) & 7);
+	else if (k > (n*w) >> 3)
+	    mask = 0;
+	if (((src[k] ^ dst[k]) & mask) || ((dst[k] ^ ~src[k]) & ~mask & 0xff)) {
+	    fprintf(stderr, "FAIL: planes_to_bits %s n=%d, w=%d\n",
+		    be?"BE":"LE", n, w);
+	    exit(1);
+	}
+    }
+}
+
+void test3()
+{
+    int j, n, w;
+
+    for (j = 0; j < 100; j++) {
+	check_transpose(0);
+	check_transpose(1);
+    }
+    for (n = 1; n <= 200; n += 13) {
+	for (w = 1; w <= 32; w++) {
+	    check_planes(0, n, w);
+	    check_planes(1, n, w);
+	}
+    }
+}
+
+//
+// morton test, compare with bit by bit interleave
+//
+void test4()
+{
+    uint64_t keys[64], k2[64];
+    uint32_t x[64], y[64], z[64];
+    uint32_t x1[64], y1[64], z1[64];
+    uint8_t buf[64*8];
+    int j, i, b;
+
+    for (j = 0; j < 1000; j++) {
+	int pos;
+	for (i = 0; i < 64; i++) {
+	    x[i] = random() ^ (random() << 16);
+	    y[i] = random() ^ (random() << 16);
+	    z[i] = random() & 0x1fffff;
+	}
+	interleave_bits_2d32_array(x, y, keys, 64);
+	for (i = 0; i < 64; i++) {
+	    uint64_t k = 0;
+	    for (b = 0; b < 32; b++)
+		k |= ((uint64_t) ((x[i] >> b) & 1) << (2*b)) |
+		    ((uint64_t) ((y[i] >> b) & 1) << (2*b+1));
+	    if ((k != keys[i]) ||
+		((uint32_t) k != interleave_bits_2d16(x[i], y[i]))) {
+		fprintf(stderr, "FAIL: interleave_bits_2d\n");
+		exit(1);
+	    }
+	}
+	deinterleave_bits_2d32_array(keys, x1, y1, 64);
+	if (memcmp(x, x1, sizeof(x)) || memcmp(y, y1, sizeof(y))) {
+	    fprintf(stderr, "FAIL: deinterleave_bits_2d\n");
+	    exit(1);
+	}
+	for (i = 0; i < 64; i++) {
+	    x[i] &= 0x1fffff;
+	    y[i] &= 0x1fffff;
+	}
+	interleave_bits_3d21_array(x, y, z, keys, 64);
+	for (i = 0; i < 64; i++) {
+	    uint64_t k = 0;
+	    for (b = 0; b < 21; b++)
+		k |= ((uint64_t) ((x[i] >> b) & 1) << (3*b)) |
+		    ((uint64_t) ((y[i] >> b) & 1) << (3*b+1)) |
+		    ((uint64_t) ((z[i] >> b) & 1) << (3*b+2));
+	    if (k != keys[i]) {
+		fprintf(stderr, "FAIL: interleave_bits_3d\n");
+		exit(1);
+	    }
+	}
+	deinterleave_bits_3d21_array(keys, x1, y1, z1, 64);
+	if (memcmp(x, x1, sizeof(x)) || memcmp(y, y1, sizeof(y)) ||
+	    memcmp(z, z1, sizeof(z))) {
+	    fprintf(stderr, "FAIL: deinterleave_bits_3d\n");
+	    exit(1);
+	}
+	// 16 bit versions
+	for (i = 0; i < 64; i++) {
+	    uint16_t a = x[i], c = y[i], d = z[i];
+	    uint16_t a1, c1, d1;
+	    uint32_t k32 = 0;
+	    uint64_t k = 0;
+	    for (b = 0; b < 16; b++) {
+		k32 |= (((a >> b) & 1) << (2*b)) |
+		    ((uint32_t) ((c >> b) & 1) << (2*b+1));
+		k |= ((uint64_t) ((a >> b) & 1) << (3*b)) |
+		    ((uint64_t) ((c >> b) & 1) << (3*b+1)) |
+		    ((uint64_t) ((d >> b) & 1) << (3*b+2));
+	    }
+	    deinterleave_bits_2d16(k32, &a1, &c1);
+	    if ((interleave_bits_2d16(a, c) != k32) || (a1 != a) || (c1 != c)) {
+		fprintf(stderr, "FAIL: interleave_bits_2d16\n");
+		exit(1);
+	    }
+	    deinterleave_bits_3d16(k, &a1, &c1, &d1);
+	    if ((interleave_bits_3d16(a, c, d) != k) || (a1 != a) ||
+		(c1 != c) || (d1 != d)) {
+		fprintf(stderr, "FAIL: interleave_bits_3d16\n");
+		exit(1);
+	    }
+	}
+	// store keys with 63 bits each at an odd offset
+	pos = 3;
+	for (i = 0; i < 64; i++)
+	    pos = set_bits_le64(buf, keys[i], pos, 63);
+	pos = 3;
+	for (i = 0; i < 64; i++)
+	    pos = get_bits_le64(buf, &k2[i], pos, 63);
+	pos = 5;
+	for (i = 0; i < 32; i++)
+	    pos = set_bits_be64(buf, keys[i], pos, 63);
+	pos = 5;
+	for (i = 0; i < 32; i++)
+	    pos = get_bits_be64(buf, &k2[i], pos, 63);
+	if (memcmp(keys, k2, sizeof(keys))) {
+	    fprintf(stderr, "FAIL: set/get_bits_le64/be64\n");
+	    exit(1);
+	}
+    }
+}
+
+//
+// compare test, flip one bit in a copy and find it again
+//
+#define CMP_SIZE 1200
+
+void check_cmp(int be, uint32_t aoffs, uint32_t boffs, size_t n)
+{
+    uint8_t a[CMP_SIZE], b[CMP_SIZE];
+    long d;
+    int k, x;
+
+    for (k = 0; k < CMP_SIZE; k++) {
+	a[k] = random();
+	b[k] = random();
+    }
+    if (be) copy_bits_be(a, aoffs, b, boffs, n);
+    else copy_bits_le(a, aoffs, b, boffs, n);
+    if ((be ? first_diff_bits_be(a, aoffs, b, boffs, n)
+	 : first_diff_bits_le(a, aoffs, b, boffs, n)) != -1) {
+	fprintf(stderr, "FAIL: equal %s %u %u %zu\n", be?"BE":"LE",
+		aoffs, boffs, n);
+	exit(1);
+    }
+    k = random() % n;
+    x = be ? get_bit_be(b, boffs+k) : get_bit_le(b, boffs+k);
+    if (be) set_bit_be(b, !x, boffs+k);
+    else set_bit_le(b, !x, boffs+k);
+    d = be ? first_diff_bits_be(a, aoffs, b, boffs, n)
+	: first_diff_bits_le(a, aoffs, b, boffs, n);
+    if ((d != k) ||
+	((be ? cmp_bits_be(a, aoffs, b, boffs, n)
+	  : cmp_bits_le(a, aoffs, b, boffs, n)) != (x ? 1 : -1))) {
+	fprintf(stderr, "FAIL: first_diff %s %u %u %zu, %ld != %d\n",
+		be?"BE":"LE", aoffs, boffs, n, d, k);
+	exit(1);
+    }
+}
+
+void test5()
+{
+    int j;
+
+    for (j = 0; j < 20000; j++) {
+	size_t n = 1 + random() % ((j & 1) ? 100 : (CMP_SIZE-8)*8 - 20);
+	uint32_t aoffs = random() % 20;
+	uint32_t boffs = (j & 2) ? aoffs : random() % 20;
+	check_cmp(j & 4, aoffs, boffs, n);
+    }
+    // numeric order of fields, le decided by the highest differing bit
+    for (j = 0; j < 20000; j++) {
+	uint8_t a[16], b[16];
+	int be = j & 1;
+	size_t n = 1 + random() % 32;
+	uint32_t aoffs = random() % 20, boffs = random() % 20;
+	uint32_t va = random() & MAKE_MASK64(n);
+	uint32_t vb = (j & 2) ? (va ^ (1u << (random() % n))) :
+	    (random() & MAKE_MASK64(n));
+	int c;
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	if (be) { set_bits_be(a, va, aoffs, n); set_bits_be(b, vb, boffs, n); }
+	else { set_bits_le(a, va, aoffs, n); set_bits_le(b, vb, boffs, n); }
+	c = be ? cmp_bits_be(a, aoffs, b, boffs, n)
+	    : cmp_bits_le(a, aoffs, b, boffs, n);
+	if (c != (va > vb) - (va < vb)) {
+	    fprintf(stderr, "FAIL: cmp_bits %s %u %u\n", be?"BE":"LE", va, vb);
+	    exit(1);
+	}
+    }
+    // two differing bits in long ranges
+    for (j = 0; j < 2000; j++) {
+	uint8_t a[CMP_SIZE], b[CMP_SIZE];
+	size_t n = 65 + random() % ((CMP_SIZE-8)*8 - 100);
+	uint32_t aoffs = random() % 20;
+	uint32_t boffs = (j & 2) ? aoffs : random() % 20;
+	size_t k1 = random() % n, k2 = random() % n;
+	int x1, x2, k;
+	for (k = 0; k < CMP_SIZE; k++)
+	    a[k] = random();
+	copy_bits_le(a, aoffs, b, boffs, n);
+	if (k1 == k2)
+	    continue;
+	if (k1 > k2) { size_t t = k1; k1 = k2; k2 = t; }
+	x1 = get_bit_le(a, aoffs+k1);
+	x2 = get_bit_le(a, aoffs+k2);
+	set_bit_le(b, !x1, boffs+k1);
+	set_bit_le(b, !x2, boffs+k2);
+	if ((first_diff_bits_le(a, aoffs, b, boffs, n) != (long) k1) ||
+	    (cmp_bits_le(a, aoffs, b, boffs, n) != (x2 ? 1 : -1)) ||
+	    (cmp_bits_le(a, aoffs, a, aoffs, n) != 0)) {
+	    fprintf(stderr, "FAIL: cmp_bits_le order %zu %zu\n", k1, k2);
+	    exit(1);
+	}
+    }
+}
+
+//
+// tracking test, replicate random updates through a delta
+//
+#define TRACK_SIZE 5000
+
+void test6()
+{
+    uint8_t a[TRACK_SIZE], b[TRACK_SIZE];
+    uint8_t delta[TRACK_SIZE + 8*((TRACK_SIZE+63)/64)];
+    bittrack_t t;
+    int j, k;
+    long len;
+
+    for (k = 0; k < TRACK_SIZE; k++)
+	a[k] = b[k] = random();
+    bittrack_init(&t, a, sizeof(a));
+    for (j = 0; j < 100; j++) {
+	int nupdates = random() % 20;
+	for (k = 0; k < nupdates; k++) {
+	    int n = 1 + random() % 32;
+	    int i = random() % (TRACK_SIZE*8 - 64);
+	    switch (random() % 4) {
+	    case 0: track_set_bits_le(&t, random(), i, n); break;
+	    case 1: track_seq_bits_be(&t, random(), i, n); break;
+	    case 2: track_set_bit_be(&t, random() & 1, i); break;
+	    case 3: track_copy_bits_le(b, random() % 1000, &t, i, 50); break;
+	    }
+	}
+	len = emit_delta(&t, NULL, 0);
+	if ((len != emit_delta(&t, delta, sizeof(delta))) ||
+	    (apply_delta(b, sizeof(b), delta, len) != 0) ||
+	    memcmp(a, b, sizeof(a))) {
+	    fprintf(stderr, "FAIL: delta\n");
+	    exit(1);
+	}
+	if (len > 8*nupdates + 3*BITTRACK_CHUNK*nupdates) {
+	    fprintf(stderr, "FAIL: delta size %ld\n", len);
+	    exit(1);
+	}
+	bittrack_clear(&t);
+    }
+    bittrack_free(&t);
+}
+
+//
+// crc test, check values and fused versus bit by bit crc
+//
+uint32_t crc_ref(crc_def_t* def, const uint8_t* p, size_t offs, size_t n,
+		 int be)
+{
+    uint32_t crc = crc_begin(def);
+    size_t i;
+    for (i = 0; i < n; i++)
+	crc = crc_bit_(def, crc, be ? get_bit_be(p, offs+i)
+		       : get_bit_le(p, offs+i));
+    return crc_end(def, crc);
+}
+
+void check_crc_value(crc_def_t* def, int be, uint32_t check)
+{
+    const char* s = "123456789";
+    uint8_t buf[16];
+    crc_writer_t w;
+    int i;
+
+    crc_writer_init(&w, buf, 0, def, be);
+    for (i = 0; s[i]; i++)
+	crc_writer_put(&w, s[i], 8);
+    if (crc_writer_finish(&w) != check) {
+	fprintf(stderr, "FAIL: crc check width=%d\n", def->width);
+	exit(1);
+    }
+}
+
+void test7()
+{
+    crc_def_t* defs[3] = { &crc32c_def, &crc15_can_def, &crc17_canfd_def };
+    uint8_t a[600], b[600];
+    int j, k;
+
+    check_crc_value(&crc32c_def, 0, 0xE3069283);
+    check_crc_value(&crc15_can_def, 1, 0x059E);
+    check_crc_value(&crc17_canfd_def, 1, 0x04F03);
+
+    for (j = 0; j < 3000; j++) {
+	crc_def_t* def = defs[j % 3];
+	int be = (j / 3) & 1;
+	uint32_t soffs = random() % 64;
+	uint32_t doffs = (j & 4) ? (random() % 8)*8 : random() % 64;
+	size_t n = random() % (8*(sizeof(a)-16));
+	uint32_t crc;
+	crc_writer_t w;
+
+	for (k = 0; k < (int) sizeof(a); k++)
+	    a[k] = b[k] = random();
+	crc = crc_begin(def);
+	if (be) copy_bits_crc_be(a, soffs, b, doffs, n, def, &crc);
+	else copy_bits_crc_le(a, soffs, b, doffs, n, def, &crc);
+	if (crc_end(def, crc) != crc_ref(def, a, soffs, n, be)) {
+	    fprintf(stderr, "FAIL: copy_bits_crc width=%d %s\n",
+		    def->width, be?"BE":"LE");
+	    exit(1);
+	}
+	// writer with random field sizes
+	crc_writer_init(&w, b, doffs, def, be);
+	while (w.pos < (int) (doffs + n))
+	    crc_writer_put(&w, random(), 1 + random() % 32);
+	if (crc_writer_finish(&w) != crc_ref(def, b, doffs, w.pos-doffs, be)) {
+	    fprintf(stderr, "FAIL: crc_writer width=%d %s\n",
+		    def->width, be?"BE":"LE");
+	    exit(1);
+	}
+    }
+}
+
+//
+// iov test, random segment chains against a flat buffer
+//
+#define IOV_SIZE 400
+
+// copy the chain into flat
+void iov_flatten(bitseg_t* seg, int nseg, uint8_t* flat)
+{
+    int i;
+    for (i = 0; i < nseg; i++) {
+	memcpy(flat, seg[i].base, seg[i].len);
+	flat += seg[i].len;
+    }
+}
+
+void test8()
+{
+    uint8_t mem[2*IOV_SIZE], flat[IOV_SIZE], flat1[IOV_SIZE], buf[IOV_SIZE+1];
+    bitseg_t seg[IOV_SIZE];
+    bitiov_t v;
+    int j, k, nseg;
+
+    for (j = 0; j < 2000; j++) {
+	int be = j & 1;
+	size_t len = 0;
+	uint8_t* p = mem;
+	// segments of 0..20 bytes with gaps between them
+	for (nseg = 0; len < IOV_SIZE; nseg++) {
+	    size_t l = random() % 21;
+	    if (len + l > IOV_SIZE)
+		l = IOV_SIZE - len;
+	    seg[nseg].base = p;
+	    seg[nseg].len = l;
+	    p += l + 1;
+	    len += l;
+	}
+	for (k = 0; k < (int) sizeof(mem); k++)
+	    mem[k] = random();
+	bitiov_init(&v, seg, nseg);
+	iov_flatten(seg, nseg, flat);
+
+	for (k = 0; k < 200; k++) {
+	    size_t i = random() % (8*IOV_SIZE - 32);
+	    size_t n = 1 + random() % 32;
+	    uint32_t x = 0, y = 0;
+	    switch (random() % 4) {
+	    case 0:
+		if (be) get_bits_iov_be(&v, &x, i, n);
+		else get_bits_iov_le(&v, &x, i, n);
+		if (be) get_bits_be(flat, &y, i, n);
+		else get_bits_le(flat, &y, i, n);
+		break;
+	    case 1:
+		x = random();
+		if (be) { set_bits_iov_be(&v, x, i, n); set_bits_be(flat, x, i, n); }
+		else { set_bits_iov_le(&v, x, i, n); set_bits_le(flat, x, i, n); }
+		x = 0;
+		break;
+	    case 2:
+		n = random() % (8*IOV_SIZE - i);
+		if (be) {
+		    copy_bits_from_iov_be(&v, i, buf, 3, n);
+		    copy_bits_be(buf, 3, flat, i, n);
+		    copy_bits_to_iov_be(buf, 3, &v, i, n);
+		}
+		else {
+		    copy_bits_from_iov_le(&v, i, buf, 3, n);
+		    copy_bits_le(buf, 3, flat, i, n);
+		    copy_bits_to_iov_le(buf, 3, &v, i, n);
+		}
+		x = 0;
+		break;
+	    case 3:
+		v.pos = i;
+		if (be) write_bits_iov_be(&v, random(), n);
+		else write_bits_iov_le(&v, random(), n);
+		v.pos = i;
+		if (be) read_bits_iov_be(&v, &x, n);
+		else read_bits_iov_le(&v, &x, n);
+		if (be) set_bits_be(flat, x, i, n);
+		else set_bits_le(flat, x, i, n);
+		y = x;
+		break;
+	    }
+	    iov_flatten(seg, nseg, flat1);
+	    if ((x != y) || memcmp(flat, flat1, IOV_SIZE)) {
+		fprintf(stderr, "FAIL: iov %s i=%zu n=%zu\n",
+			be?"BE":"LE", i, n);
+		exit(1);
+	    }
+	}
+    }
+}
+
+//
+// statistics test, only with -DBITPACK_STATS
+//
+void test9()
+{
+#ifdef BITPACK_STATS
+    uint8_t buf[16], buf1[16];
+    uint32_t v;
+    bitpack_stats_t* s;
+    bitpack_stats_t sum;
+
+    bitpack_stats_reset();
+    set_bits_le(buf, 5, 3, 4);         // same byte
+    set_bits_le(buf, 0x1234, 8, 16);   // aligned
+    get_bits_be(buf, &v, 5, 11);       // shifted
+    copy_bits_le(buf, 0, buf1, 0, 64); // aligned byte copy
+    copy_bits_be(buf, 3, buf1, 1, 40); // shifted
+    clr_bits_le(buf1, 2, 40);          // wider than 32 bits
+    s = bitpack_stats();
+    if ((s->calls[BITPACK_OP_SET][0][BITPACK_PATH_BYTE] != 1) ||
+	(s->calls[BITPACK_OP_SET][0][BITPACK_PATH_ALIGNED] != 1) ||
+	(s->calls[BITPACK_OP_GET][1][BITPACK_PATH_SHIFTED] != 1) ||
+	(s->calls[BITPACK_OP_COPY][0][BITPACK_PATH_ALIGNED] != 1) ||
+	(s->calls[BITPACK_OP_COPY][1][BITPACK_PATH_SHIFTED] != 1) ||
+	(s->calls[BITPACK_OP_SET][0][BITPACK_PATH_SHIFTED] != 1) ||
+	(s->bits[BITPACK_OP_SET][0] != 60) ||
+	(s->hist[BITPACK_OP_SET][0][2][BITPACK_MAX_WIDTH] != 1) ||
+	(s->hist[BITPACK_OP_GET][1][5][11] != 1) ||
+	(s->hist[BITPACK_OP_COPY][0][0][BITPACK_MAX_WIDTH] != 1)) {
+	fprintf(stderr, "FAIL: stats\n");
+	bitpack_stats_dump(stderr, s);
+	exit(1);
+    }
+    memset(&sum, 0, sizeof(sum));
+    bitpack_stats_merge(&sum, s);
+    bitpack_stats_merge(&sum, s);
+    if (sum.bits[BITPACK_OP_COPY][1] != 80) {
+	fprintf(stderr, "FAIL: stats merge\n");
+	exit(1);
+    }
+#endif
+}
+
+//
+// columnar test, decode/encode against get_bits/set_bits per record
+//
+#define COL_RECS 300
+
+void check_columns(int be, size_t stride, int nfields,
+		   const bitcol_field_t* field)
+{
+    bitcol_layout_t l = { stride, be, nfields, field };
+    size_t nbytes = (COL_RECS*stride + 7) / 8;
+    uint8_t* a = malloc(nbytes);
+    uint8_t* b = malloc(nbytes);
+    uint32_t* cols[8];
+    int k;
+    size_t r;
+
+    for (r = 0; r < nbytes; r++)
+	a[r] = b[r] = random();
+    for (k = 0; k < nfields; k++)
+	cols[k] = malloc(COL_RECS*sizeof(uint32_t));
+    decode_columns(&l, a, COL_RECS, cols);
+    for (k = 0; k < nfields; k++) {
+	for (r = 0; r < COL_RECS; r++) {
+	    uint32_t v = 0;
+	    int o = r*stride + field[k].offset;
+	    if (be) get_bits_be(a, &v, o, field[k].width);
+	    else get_bits_le(a, &v, o, field[k].width);
+	    if (field[k].sign)
+		v = bitcol_sign_(v, field[k].width);
+	    if (v != cols[k][r]) {
+		fprintf(stderr, "FAIL: decode_columns %s stride=%zu\n",
+			be?"BE":"LE", stride);
+		exit(1);
+	    }
+	    cols[k][r] = random();  // new values for encode
+	    if (be) set_bits_be(a, cols[k][r] & MAKE_MASK64(field[k].width),
+				o, field[k].width);
+	    else set_bits_le(a, cols[k][r] & MAKE_MASK64(field[k].width),
+			     o, field[k].width);
+	}
+    }
+    encode_columns(&l, cols, COL_RECS, b);
+    if (memcmp(a, b, nbytes)) {
+	fprintf(stderr, "FAIL: encode_columns %s stride=%zu\n",
+		be?"BE":"LE", stride);
+	exit(1);
+    }
+    for (k = 0; k < nfields; k++)
+	free(cols[k]);
+    free(a);
+    free(b);
+}
+
+void test10()
+{
+    // with gaps between fields, stride 64 and 61 bits
+    bitcol_field_t f1[] = { { 0, 3, 0 }, { 3, 12, 1 }, { 17, 32, 0 },
+			    { 50, 11, 1 } };
+    // byte sized and crossing byte boundaries, stride 24 and 27 bits
+    bitcol_field_t f2[] = { { 0, 8, 0 }, { 8, 8, 1 }, { 19, 5, 0 } };
+    int be;
+
+    for (be = 0; be < 2; be++) {
+	check_columns(be, 64, 4, f1);
+	check_columns(be, 61, 4, f1);
+	check_columns(be, 24, 3, f2);
+	check_columns(be, 27, 3, f2);
+    }
+}
+
+//
+// view test, lazy get and predicates against decoded values
+//
+void test11()
+{
+    bitcol_field_t f[] = { { 0, 3, 0 }, { 3, 12, 1 }, { 17, 32, 0 },
+			   { 52, 11, 1 }, { 70, 5, 0 }, { 75, 20, 1 } };
+    bitcol_layout_t l = { 95, 0, 6, f };
+    bitview_layout_t c;
+    uint8_t msg[12];
+    uint32_t cache[6];
+    int j, k, op;
+
+    for (l.be = 0; l.be < 2; l.be++) {
+	if (bitview_compile(&c, &l) < 0) {
+	    fprintf(stderr, "FAIL: bitview_compile\n");
+	    exit(1);
+	}
+	for (j = 0; j < 10000; j++) {
+	    bitview_t v;
+	    for (k = 0; k < (int) sizeof(msg); k++)
+		msg[k] = random();
+	    bitview_init(&v, &c, msg, (j & 1) ? cache : NULL);
+	    for (k = 0; k < 6; k++) {
+		uint32_t x = 0, y;
+		int r = random() % 4;
+		bitview_pred_t p;
+		if (l.be) get_bits_be(msg, &x, f[k].offset, f[k].width);
+		else get_bits_le(msg, &x, f[k].offset, f[k].width);
+		if (f[k].sign)
+		    x = bitcol_sign_(x, f[k].width);
+		if ((bitview_get(&v, k) != x) || (bitview_get(&v, k) != x)) {
+		    fprintf(stderr, "FAIL: bitview_get %d\n", k);
+		    exit(1);
+		}
+		// constant equal, just below, random or just out of range
+		y = (r == 0) ? x : (r == 1) ? x - 1 : random();
+		if ((r == 3) && f[k].sign)
+		    y = (random() & 1) ? 1u << (f[k].width - 1)
+			: -(1u << (f[k].width - 1)) - 1;
+		else if (r == 3)
+		    y = (uint32_t) MAKE_MASK64(f[k].width) + 1;
+		for (op = BITPACK_EQ; op <= BITPACK_GE; op++) {
+		    int c1 = f[k].sign ?
+			((int32_t) x > (int32_t) y) - ((int32_t) x < (int32_t) y)
+			: (x > y) - (x < y);
+		    if ((bitview_pred_init(&p, &c, k, op, y) < 0) ||
+			(bitview_match(&c, &p, 1, msg) != bitview_cmp_(op, c1))) {
+			fprintf(stderr, "FAIL: bitview pred %d op=%d\n", k, op);
+			exit(1);
+		    }
+		}
+	    }
+	    // out of range constants give a fixed result, field 0 is
+	    // byte aligned on the fast path, field 4 unaligned and slow
+	    for (k = 0; k < 5; k += 4) {
+		uint32_t big[2] = { (uint32_t) MAKE_MASK64(f[k].width) + 1,
+				    0xffffffff };
+		static const int want[] = { 0, 1, 1, 1, 0, 0 };
+		bitview_pred_t p;
+		if (c.field[k].fast != (k == 0)) {
+		    fprintf(stderr, "FAIL: bitview fast %d\n", k);
+		    exit(1);
+		}
+		for (op = BITPACK_EQ; op <= BITPACK_GE; op++) {
+		    if ((bitview_pred_init(&p, &c, k, op, big[j & 1]) < 0) ||
+			(bitview_test(&c, &p, msg) != want[op])) {
+			fprintf(stderr, "FAIL: bitview range %d op=%d\n", k, op);
+			exit(1);
+		    }
+		}
+	    }
+	}
+	bitview_free(&c);
+    }
+}
+
+//
+// scan test, predicate bitmaps against get_bits and compare
+//
+void test12()
+{
+    uint8_t col[4*1000+8];
+    uint8_t bm[1000/8+1], exp[1000/8+1];
+    int be, w, j, op;
+
+    for (be = 0; be < 2; be++) {
+	for (w = 1; w <= 32; w++) {
+	    for (j = 0; j < 20; j++) {
+		size_t n = random() % 1000;
+		size_t i, nb = (n + 7) >> 3;
+		uint32_t c, lo, hi, m = (uint32_t) MAKE_MASK64(w);
+		for (i = 0; i < sizeof(col); i++)
+		    col[i] = random();
+		// small range so that all predicates select something
+		if ((w > 3) && (j & 1)) {
+		    for (i = 0; i < n; i++) {
+			uint32_t v = random() & 7;
+			if (be) set_bits_be(col, v, i*w, w);
+			else set_bits_le(col, v, i*w, w);
+		    }
+		}
+		c = (j & 1) ? (random() & 7) : (random() & m);
+		lo = random() & m;
+		hi = (j & 2) ? lo + (random() & 7) : random() & m;
+		for (op = -1; op <= BITPACK_GE; op++) {
+		    memset(bm, 0xa5, sizeof(bm));
+		    memset(exp, 0, sizeof(exp));
+		    for (i = 0; i < n; i++) {
+			uint32_t x = 0;
+			int s = 0;
+			if (be) get_bits_be(col, &x, i*w, w);
+			else get_bits_le(col, &x, i*w, w);
+			switch(op) {
+			case -1: s = (x >= lo) && (x <= hi); break;
+			case BITPACK_EQ: s = (x == c); break;
+			case BITPACK_NE: s = (x != c); break;
+			case BITPACK_LT: s = (x < c); break;
+			case BITPACK_LE: s = (x <= c); break;
+			case BITPACK_GT: s = (x > c); break;
+			case BITPACK_GE: s = (x >= c); break;
+			}
+			if (s)
+			    exp[i>>3] |= be ? (0x80 >> (i&7)) : (1 << (i&7));
+		    }
+		    if (op < 0) {
+			if (be) scan_range_be(col, n, w, lo, hi, bm);
+			else scan_range_le(col, n, w, lo, hi, bm);
+		    }
+		    else {
+			if (be) scan_bits_be(col, n, w, op, c, bm);
+			else scan_bits_le(col, n, w, op, c, bm);
+		    }
+		    if (memcmp(bm, exp, nb) != 0) {
+			fprintf(stderr, "FAIL: scan be=%d w=%d n=%d op=%d\n",
+				be, w, (int) n, op);
+			exit(1);
+		    }
+		}
+	    }
+	}
+    }
+}
+
+//
+// bit buffer test, append fields and read them back, check that a
+// reset buffer does not allocate again
+//
+static int test13_nalloc = 0;
+
+static void* test13_alloc(void* ctx, size_t size)
+{
+    test13_nalloc++;
+    return bitarena_alloc((bitarena_t*) ctx, size);
+}
+
+void test13()
+{
+    bitarena_t arena;
+    bitbuf_allocator_t al;
+    int be, a, j, k;
+
+    bitarena_init(&arena, 4096);
+    bitarena_allocator(&arena, &al);
+    al.alloc = test13_alloc;
+    for (a = 0; a < 2; a++) {
+	for (be = 0; be < 2; be++) {
+	    bitbuf_t b;
+	    int nalloc = 0;
+	    bitbuf_init(&b, a ? &al : NULL, 0);
+	    for (j = 0; j < 20; j++) {
+		uint32_t val[500];
+		uint8_t wid[500];
+		size_t pos = 0;
+		bitbuf_reset(&b);
+		if (j == 1)
+		    nalloc = test13_nalloc;
+		for (k = 0; k < 500; k++) {
+		    wid[k] = random() % 33;
+		    val[k] = random();
+		    if ((be ? bitbuf_seq_bits_be(&b, val[k], wid[k]) :
+			 bitbuf_seq_bits_le(&b, val[k], wid[k])) < 0) {
+			fprintf(stderr, "FAIL: bitbuf_seq_bits\n");
+			exit(1);
+		    }
+		}
+		for (k = 0; k < 500; k++) {
+		    uint32_t x = 0;
+		    if (be) get_bits_be(b.ptr, &x, pos, wid[k]);
+		    else get_bits_le(b.ptr, &x, pos, wid[k]);
+		    if (x != (uint32_t) (val[k] & MAKE_MASK64(wid[k]))) {
+			fprintf(stderr, "FAIL: bitbuf be=%d field %d\n", be, k);
+			exit(1);
+		    }
+		    pos += wid[k];
+		}
+		if (pos != bitbuf_bits(&b)) {
+		    fprintf(stderr, "FAIL: bitbuf_bits\n");
+		    exit(1);
+		}
+	    }
+	    // 500 fields of at most 32 bits, all messages fit after 2 KB
+	    if (a && (b.size >= 2000) && (test13_nalloc - nalloc > 1)) {
+		fprintf(stderr, "FAIL: bitbuf allocates after reset\n");
+		exit(1);
+	    }
+	    bitbuf_free(&b);
+	}
+	bitarena_reset(&arena);
+    }
+    bitarena_destroy(&arena);
+}
+
+//
+// ring test, records of pseudo random size and content produced and
+// consumed in bursts, and from two threads with BITPACK_THREADS
+//
+#define RING_RECORDS 200000
+#define RING_MAX_BITS 300
+
+static uint32_t ring_hash(uint32_t x)
+{
+    x ^= x >> 16; x *= 0x7feb352d;
+    x ^= x >> 15; x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static void ring_put(bitring_t* r, const bitring_rec_t* rec, uint32_t k)
+{
+    size_t j;
+    for (j = 0; j < rec->n; j += 32) {
+	size_t w = (rec->n - j < 32) ? rec->n - j : 32;
+	uint32_t v = ring_hash(k * 16 + j / 32);
+	if (r->flags & BITRING_BE)
+	    seq_bits_be(rec->ptr, v & MAKE_MASK64(w), rec->offs + j, w);
+	else
+	    seq_bits_le(rec->ptr, v & MAKE_MASK64(w), rec->offs + j, w);
+    }
+}
+
+static void ring_check(bitring_t* r, const bitring_rec_t* rec, uint32_t k)
+{
+    size_t j;
+    if ((rec->n != ring_hash(k) % RING_MAX_BITS) || rec->offs) {
+	fprintf(stderr, "FAIL: ring record %u size %zu\n", k, rec->n);
+	exit(1);
+    }
+    for (j = 0; j < rec->n; j += 32) {
+	size_t w = (rec->n - j < 32) ? rec->n - j : 32;
+	uint32_t x = 0;
+	if (r->flags & BITRING_BE)
+	    get_bits_be(rec->ptr, &x, rec->offs + j, w);
+	else
+	    get_bits_le(rec->ptr, &x, rec->offs + j, w);
+	if (x != (uint32_t) (ring_hash(k * 16 + j / 32) & MAKE_MASK64(w))) {
+	    fprintf(stderr, "FAIL: ring record %u bits %zu\n", k, j);
+	    exit(1);
+	}
+    }
+}
+
+#ifdef BITPACK_THREADS
+static void* ring_producer(void* arg)
+{
+    bitring_t* r = (bitring_t*) arg;
+    bitring_rec_t rec;
+    uint32_t k = 0;
+    while (k < RING_RECORDS) {
+	if (bitring_reserve(r, ring_hash(k) % RING_MAX_BITS, &rec) < 0) {
+	    bitring_publish(r);
+	    continue;
+	}
+	ring_put(r, &rec, k);
+	bitring_commit(r, &rec);
+	if ((++k & 7) == 0)
+	    bitring_publish(r);
+    }
+    bitring_publish(r);
+    return NULL;
+}
+#endif
+
+void test14()
+{
+    int flags;
+
+    for (flags = 0; flags < 4; flags++) {
+	bitring_t r;
+	bitring_rec_t rec;
+	uint32_t kp = 0, kc = 0;
+	if (bitring_init(&r, 256, RING_MAX_BITS, flags) < 0) {
+	    fprintf(stderr, "FAIL: bitring_init\n");
+	    exit(1);
+	}
+	while (kc < 20000) {
+	    int m = random() % 16;
+	    while (m-- && (bitring_reserve(&r, ring_hash(kp) % RING_MAX_BITS,
+					   &rec) == 0)) {
+		ring_put(&r, &rec, kp++);
+		bitring_commit(&r, &rec);
+	    }
+	    bitring_publish(&r);
+	    m = random() % 16;
+	    while (m-- && (bitring_peek(&r, &rec) == 0)) {
+		ring_check(&r, &rec, kc++);
+		bitring_consume(&r, &rec);
+	    }
+	    bitring_release(&r);
+	}
+	bitring_free(&r);
+#ifdef BITPACK_THREADS
+	{
+	    pthread_t t;
+	    bitring_init(&r, 4096, RING_MAX_BITS, flags);
+	    pthread_create(&t, NULL, ring_producer, &r);
+	    for (kc = 0; kc < RING_RECORDS; ) {
+		if (bitring_peek(&r, &rec) < 0) {
+		    bitring_release(&r);
+		    continue;
+		}
+		ring_check(&r, &rec, kc++);
+		bitring_consume(&r, &rec);
+		if ((kc & 7) == 0)
+		    bitring_release(&r);
+	    }
+	    pthread_join(t, NULL);
+	    bitring_free(&r);
+	}
+#endif
+    }
+}
+
+//
+// compressed bitmap test, raw bitmaps round trip, count, rank and
+// set operations against byte wise results
+//
+static void roar_fill(uint8_t* p, size_t nbits, int kind)
+{
+    size_t i;
+    memset(p, 0, (nbits + 7) >> 3);
+    switch(kind) {
+    case 0:  // sparse
+	for (i = 0; i < nbits / 300; i++) {
+	    size_t x = random() % nbits;
+	    p[x >> 3] |= 1 << (x & 7);
+	}
+	break;
+    case 1:  // runs
+	for (i = 0; i < nbits; ) {
+	    size_t len = 1 + random() % 3000;
+	    if (random() & 1)
+		clr_bits_le(p, i, (i + len > nbits) ? nbits - i : len);
+	    else {
+		size_t k;
+		for (k = i; (k < i + len) && (k < nbits); k++)
+		    p[k >> 3] |= 1 << (k & 7);
+	    }
+	    i += len;
+	}
+	break;
+    default:  // dense
+	for (i = 0; i < (nbits + 7) >> 3; i++)
+	    p[i] = random();
+	if (nbits & 7)
+	    p[nbits >> 3] &= MAKE_MASK(nbits & 7);
+	break;
+    }
+}
+
+void test15()
+{
+    size_t nmax = 400000;
+    uint8_t* a = (uint8_t*) malloc(nmax/8+1);
+    uint8_t* b = (uint8_t*) malloc(nmax/8+1);
+    uint8_t* c = (uint8_t*) malloc(nmax/8+1);
+    uint8_t* d = (uint8_t*) malloc(nmax/8+1);
+    int j, op;
+
+    for (j = 0; j < 30; j++) {
+	size_t nbits = 1 + random() % nmax;
+	size_t nb = (nbits + 7) >> 3, i;
+	int be = j & 1;
+	bitroar_t ra, rb, rc;
+	uint64_t n = 0;
+
+	roar_fill(a, nbits, j % 3);
+	roar_fill(b, nbits, (j / 3) % 3);
+	if (j & 2)  // chunks only in a
+	    memset(b + nb/2, 0, nb - nb/2);
+	if (j & 4)  // first chunk only in b
+	    memset(a, 0, (nb < 8192) ? nb : 8192);
+	if (be) {  // same bits in big endian order
+	    for (i = 0; i < nb; i++) {
+		a[i] = bitroar_rev8_(a[i]) & 0xff;
+		b[i] = bitroar_rev8_(b[i]) & 0xff;
+	    }
+	}
+	bitroar_init(&ra);
+	bitroar_init(&rb);
+	bitroar_init(&rc);
+	if (be) {
+	    bitroar_from_bits_be(&ra, a, nbits);
+	    bitroar_from_bits_be(&rb, b, nbits);
+	    bitroar_to_bits_be(&ra, c, nbits);
+	}
+	else {
+	    bitroar_from_bits_le(&ra, a, nbits);
+	    bitroar_from_bits_le(&rb, b, nbits);
+	    bitroar_to_bits_le(&ra, c, nbits);
+	}
+	if (memcmp(a, c, nb) != 0) {
+	    fprintf(stderr, "FAIL: bitroar round trip\n");
+	    exit(1);
+	}
+	for (i = 0; i < nbits; i++) {
+	    int v = be ? get_bit_be(a, i) : get_bit_le(a, i);
+	    n += v;
+	    if ((random() % 1000) == 0) {
+		if ((bitroar_rank(&ra, i) != n) ||
+		    (bitroar_contains(&ra, i) != v)) {
+		    fprintf(stderr, "FAIL: bitroar rank/contains %zu\n", i);
+		    exit(1);
+		}
+	    }
+	}
+	if (bitroar_count(&ra) != n) {
+	    fprintf(stderr, "FAIL: bitroar_count\n");
+	    exit(1);
+	}
+	for (op = BITROAR_AND; op <= BITROAR_ANDNOT; op++) {
+	    uint64_t m = 0;
+	    bitroar_op_(&rc, &ra, &rb, op);
+	    if (be) bitroar_to_bits_be(&rc, c, nbits);
+	    else bitroar_to_bits_le(&rc, c, nbits);
+	    for (i = 0; i < nb; i++) {
+		switch(op) {
+		case BITROAR_AND:    d[i] = a[i] & b[i]; break;
+		case BITROAR_OR:     d[i] = a[i] | b[i]; break;
+		case BITROAR_XOR:    d[i] = a[i] ^ b[i]; break;
+		case BITROAR_ANDNOT: d[i] = a[i] & ~b[i]; break;
+		}
+		m += __builtin_popcount(d[i]);
+	    }
+	    if ((memcmp(c, d, nb) != 0) || (bitroar_count(&rc) != m)) {
+		fprintf(stderr, "FAIL: bitroar op %d\n", op);
+		exit(1);
+	    }
+	}
+	bitroar_free(&ra);
+	bitroar_free(&rb);
+	bitroar_free(&rc);
+    }
+    free(a);
+    free(b);
+    free(c);
+    free(d);
+}
+
+//
+// byte aligned fields, set/get_bytes and the array conversions
+// against byte by byte composition
+//
+static uint64_t bytes_val(const uint8_t* p, size_t size, int be)
+{
+    uint64_t v = 0;
+    size_t k;
+    for (k = 0; k < size; k++)
+	v |= (uint64_t) p[be ? size-1-k : k] << (8*k);
+    return v;
+}
+
+void test16()
+{
+    uint8_t buf[300], buf1[300];
+    uint64_t vals[36];
+    int be, j;
+    size_t k, size, n;
+
+    for (be = 0; be < 2; be++) {
+	for (j = 0; j < 1000; j++) {
+	    int i = random() % 64;
+	    uint32_t v = random(), x = 0;
+	    n = random() % 5;
+	    for (k = 0; k < sizeof(buf); k++)
+		buf[k] = random();
+	    memcpy(buf1, buf, sizeof(buf));
+	    if (((be ? set_bytes_be(buf, v, i, n) + (n != 0) :
+		  set_bytes_le(buf, v, i, n)) != i + (int) n) ||
+		(bytes_val(buf+i, n, be) != (v & MAKE_MASK64(8*n))) ||
+		memcmp(buf, buf1, i) ||
+		memcmp(buf+i+n, buf1+i+n, sizeof(buf)-i-n)) {
+		fprintf(stderr, "FAIL: set_bytes be=%d n=%zu\n", be, n);
+		exit(1);
+	    }
+	    if (((be ? get_bytes_be(buf, &x, i, n) :
+		  get_bytes_le(buf, &x, i, n)) != i + (int) n) ||
+		(x != (v & MAKE_MASK64(8*n)))) {
+		fprintf(stderr, "FAIL: get_bytes be=%d n=%zu\n", be, n);
+		exit(1);
+	    }
+	    // byte aligned 16/32 bit set_bits/get_bits
+	    n = (j & 1) ? 16 : 32;
+	    memcpy(buf1, buf, sizeof(buf));
+	    if (be) set_bits_be(buf, v, 8*i, n);
+	    else set_bits_le(buf, v, 8*i, n);
+	    if (be) get_bits_be(buf, &x, 8*i, n);
+	    else get_bits_le(buf, &x, 8*i, n);
+	    if ((bytes_val(buf+i, n/8, be) != (v & MAKE_MASK64(n))) ||
+		(x != (v & MAKE_MASK64(n))) ||
+		memcmp(buf+i+n/8, buf1+i+n/8, sizeof(buf)-i-n/8)) {
+		fprintf(stderr, "FAIL: aligned bits be=%d n=%zu\n", be, n);
+		exit(1);
+	    }
+	}
+	for (size = 1; size <= 8; size <<= 1) {
+	    for (j = 0; j < 100; j++) {
+		size_t off = random() % 8;
+		n = random() % (sizeof(vals) / 8 * 8 / size);
+		for (k = 0; k < sizeof(buf); k++)
+		    buf[k] = random();
+		if (be) get_bytes_be_array(buf+off, vals, n, size);
+		else get_bytes_le_array(buf+off, vals, n, size);
+		for (k = 0; k < n; k++) {
+		    uint64_t x = 0;
+		    memcpy((uint8_t*) &x + ((__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) ? 8-size : 0),
+			   (uint8_t*) vals + k*size, size);
+		    if (x != bytes_val(buf+off+k*size, size, be)) {
+			fprintf(stderr, "FAIL: get_bytes_array be=%d size=%zu\n",
+				be, size);
+			exit(1);
+		    }
+		}
+		memset(buf1, 0, sizeof(buf1));
+		if (be) set_bytes_be_array(buf1+off, vals, n, size);
+		else set_bytes_le_array(buf1+off, vals, n, size);
+		if (memcmp(buf1+off, buf+off, n*size) != 0) {
+		    fprintf(stderr, "FAIL: set_bytes_array be=%d size=%zu\n",
+			    be, size);
+		    exit(1);
+		}
+	    }
+	}
+    }
+}
+
+//
+// parallel copy test, copy_bits_mt against copy_bits
+//
+void test17()
+{
+#ifdef BITPACK_THREADS
+    size_t size = 1 << 20;
+    uint8_t* src = (uint8_t*) malloc(size);
+    uint8_t* dst = (uint8_t*) malloc(size);
+    uint8_t* dst1 = (uint8_t*) malloc(size);
+    bitpack_pool_t pool;
+    size_t k;
+    int j, nt;
+
+    for (k = 0; k < size; k++)
+	src[k] = random();
+    for (nt = 0; nt <= 3; nt += 3) {
+	bitpack_pool_init(&pool, nt);
+	for (j = 0; j < 40; j++) {
+	    int be = j & 1;
+	    size_t soffs = random() % (8*size/4);
+	    size_t doffs = random() % (8*size/4);
+	    size_t n = (j & 2) ? random() % 100 : random() % (8*size/2);
+	    for (k = 0; k < size; k++)
+		dst[k] = dst1[k] = random();
+	    if (be) {
+		copy_bits_be_mt(&pool, src, soffs, dst, doffs, n);
+		copy_bits_be(src, soffs, dst1, doffs, n);
+	    }
+	    else {
+		copy_bits_le_mt(&pool, src, soffs, dst, doffs, n);
+		copy_bits_le(src, soffs, dst1, doffs, n);
+	    }
+	    if (memcmp(dst, dst1, size) != 0) {
+		fprintf(stderr, "FAIL: copy_bits_mt be=%d n=%zu\n", be, n);
+		exit(1);
+	    }
+	}
+	bitpack_pool_destroy(&pool);
+    }
+    free(src);
+    free(dst);
+    free(dst1);
+#endif
+}
+
+//
+// file test, write groups and read back all, selected and skipped
+// blocks, a truncated file must not open
+//
+void test18()
+{
+    const char* names[3] = { "ts", "const", "value" };
+    char path[64];
+    bitfile_writer_t w;
+    bitfile_t r;
+    uint32_t* cols[3];
+    uint32_t* out = (uint32_t*) malloc(5000*sizeof(uint32_t));
+    uint8_t bm[5000/8+1];
+    size_t nrows[6], g, i;
+    uint32_t ts = 0;
+    int k;
+
+    snprintf(path, sizeof(path), "/tmp/bit_test_%d.bpk", (int) getpid());
+    for (k = 0; k < 3; k++)
+	cols[k] = (uint32_t*) malloc(6*5000*sizeof(uint32_t));
+    if (bitfile_create(&w, path, 3, names) < 0) {
+	fprintf(stderr, "FAIL: bitfile_create\n");
+	exit(1);
+    }
+    for (g = 0; g < 6; g++) {
+	const uint32_t* c[3];
+	nrows[g] = 1 + random() % 5000;
+	for (i = 0; i < nrows[g]; i++) {
+	    ts += random() % 4;
+	    cols[0][g*5000+i] = ts;
+	    cols[1][g*5000+i] = 1234567;
+	    cols[2][g*5000+i] = (g == 3) ? random() : random() % 1000;
+	}
+	for (k = 0; k < 3; k++)
+	    c[k] = cols[k] + g*5000;
+	if (bitfile_write_group(&w, c, nrows[g]) < 0) {
+	    fprintf(stderr, "FAIL: bitfile_write_group\n");
+	    exit(1);
+	}
+    }
+    if ((bitfile_finish(&w) < 0) || (bitfile_open(&r, path) < 0) ||
+	(r.ngroups != 6) || (bitfile_column(&r, "value") != 2)) {
+	fprintf(stderr, "FAIL: bitfile open\n");
+	exit(1);
+    }
+    for (g = 0; g < 6; g++) {
+	uint32_t lo = cols[0][g*5000] + random() % 100;
+	uint32_t hi = lo + random() % 100;
+	long n = 0;
+	for (k = 0; k < 3; k++) {
+	    if ((bitfile_read(&r, g, k, out) != (long) nrows[g]) ||
+		memcmp(out, cols[k] + g*5000, nrows[g]*sizeof(uint32_t))) {
+		fprintf(stderr, "FAIL: bitfile_read %zu %d\n", g, k);
+		exit(1);
+	    }
+	}
+	bitfile_select(&r, g, 0, lo, hi, bm);
+	for (i = 0; i < nrows[g]; i++) {
+	    uint32_t x = cols[0][g*5000+i];
+	    if (get_bit_le(bm, i) != ((x >= lo) && (x <= hi))) {
+		fprintf(stderr, "FAIL: bitfile_select %zu\n", g);
+		exit(1);
+	    }
+	    n += get_bit_le(bm, i);
+	}
+	// values of the selected rows in row order
+	if (bitfile_read_sel(&r, g, 2, bm, out) != n) {
+	    fprintf(stderr, "FAIL: bitfile_read_sel count\n");
+	    exit(1);
+	}
+	for (i = 0, n = 0; i < nrows[g]; i++) {
+	    if (get_bit_le(bm, i) && (out[n++] != cols[2][g*5000+i])) {
+		fprintf(stderr, "FAIL: bitfile_read_sel\n");
+		exit(1);
+	    }
+	}
+	if (bitfile_skip(&r, g, 0, lo, hi) && n) {
+	    fprintf(stderr, "FAIL: bitfile_skip\n");
+	    exit(1);
+	}
+    }
+    if (!bitfile_skip(&r, 0, 0, cols[0][5*5000+nrows[5]-1] + 1, ~0)) {
+	fprintf(stderr, "FAIL: bitfile_skip range\n");
+	exit(1);
+    }
+    bitfile_close(&r);
+    if ((truncate(path, 100) < 0) || (bitfile_open(&r, path) == 0)) {
+	fprintf(stderr, "FAIL: bitfile truncated\n");
+	exit(1);
+    }
+    unlink(path);
+    for (k = 0; k < 3; k++)
+	free(cols[k]);
+    free(out);
+}
+
+//
+// bitgen test, generated pack/unpack against set_bits/get_bits
+//
+void test19()
+{
+    bitgen_round_trip(10000);
+}
+
 main()
 {
     test1();
+    test2();
+    test3();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
     exit(0);
 }
@@ -0,0 +1,217 @@
+//
+// bitfile_bench - reader benchmark on a synthetic packed columnar file
+//
+// Build: gcc -O2 -march=native -o bitfile_bench bitfile_bench.c
+//
+// Usage: bitfile_bench [-s GB] [-r rows] [-k] file
+//   -s GB     size of the generated data unpacked (4 columns of 32 bit
+//             values), default 4
+//   -r rows   rows per group, default 1048576
+//   -k        keep the file when it exists, do not generate
+//
+// Columns:
+//   ts      time stamp, increasing by 0..7 per row
+//   sensor  0..1023
+//   value   20 bit measurement
+//   flag    0..3
+//
+// Queries:
+//   full     sum of all values, all columns of all groups decoded
+//   project  sum(value), only the value column is decoded
+//   filter   sum(value) where ts is in a 1% range. Groups are skipped
+//            on the ts statistics, rows are selected on the packed ts
+//            bits and only the selected values are decoded
+//
+// Bytes touched is the packed size of the blocks read. The file is
+// mapped, the first query may include reading it from disk.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bitpack_file.h"
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void generate(const char* file, double gb, size_t rows)
+{
+    const char* names[4] = { "ts", "sensor", "value", "flag" };
+    uint64_t total = (uint64_t) (gb * (1 << 30)) / 16;
+    bitfile_writer_t w;
+    uint32_t* cols[4];
+    uint32_t ts = 0;
+    uint64_t done = 0;
+    double t0 = now();
+    size_t i;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+	if (!(cols[k] = (uint32_t*) malloc(rows * sizeof(uint32_t)))) {
+	    fprintf(stderr, "out of memory\n");
+	    exit(1);
+	}
+    }
+    if (bitfile_create(&w, file, 4, names) < 0) {
+	fprintf(stderr, "unable to create %s\n", file);
+	exit(1);
+    }
+    while (done < total) {
+	size_t n = (total - done < rows) ? total - done : rows;
+	for (i = 0; i < n; i++) {
+	    uint32_t r = rnd();
+	    ts += r & 7;
+	    cols[0][i] = ts;
+	    cols[1][i] = (r >> 3) & 1023;
+	    cols[2][i] = rnd() & 0xfffff;
+	    cols[3][i] = (r >> 13) & 3;
+	}
+	if (bitfile_write_group(&w, (const uint32_t* const*) cols, n) < 0) {
+	    fprintf(stderr, "write error\n");
+	    exit(1);
+	}
+	done += n;
+    }
+    if (bitfile_finish(&w) < 0) {
+	fprintf(stderr, "write error\n");
+	exit(1);
+    }
+    for (k = 0; k < 4; k++)
+	free(cols[k]);
+    printf("generated %llu rows in %.2f s\n", (unsigned long long) total,
+	   now() - t0);
+}
+
+static void report(const char* name, double t, uint64_t rows,
+		   uint64_t bytes, size_t read, size_t ngroups, uint64_t sum)
+{
+    printf("%-8s %8.3f s  %7.1f Mrows/s  %8.1f MB touched  "
+	   "%zu/%zu groups  sum=%llu\n", name, t, rows / t * 1e-6,
+	   bytes / 1e6, read, ngroups, (unsigned long long) sum);
+}
+
+int main(int argc, char** argv)
+{
+    double gb = 4;
+    size_t rows = 1 << 20;
+    int keep = 0;
+    const char* file = NULL;
+    bitfile_t r;
+    uint32_t* out;
+    uint8_t* bm;
+    uint64_t nrows = 0, bytes, sum;
+    uint32_t lo, hi, tmax;
+    size_t g, read;
+    int i, k, kts, kval;
+    double t;
+
+    for (i = 1; i < argc; i++) {
+	if ((strcmp(argv[i], "-s") == 0) && (i+1 < argc))
+	    gb = atof(argv[++i]);
+	else if ((strcmp(argv[i], "-r") == 0) && (i+1 < argc))
+	    rows = strtoul(argv[++i], NULL, 0);
+	else if (strcmp(argv[i], "-k") == 0)
+	    keep = 1;
+	else if (argv[i][0] != '-')
+	    file = argv[i];
+	else
+	    file = NULL, i = argc;
+    }
+    if (!file || (gb <= 0) || (rows == 0) || (rows > BITFILE_MAX_ROWS)) {
+	fprintf(stderr, "usage: bitfile_bench [-s GB] [-r rows] [-k] file\n");
+	exit(1);
+    }
+    if (!keep || (access(file, R_OK) != 0))
+	generate(file, gb, rows);
+    if (bitfile_open(&r, file) < 0) {
+	fprintf(stderr, "unable to open %s\n", file);
+	exit(1);
+    }
+    kts = bitfile_column(&r, "ts");
+    kval = bitfile_column(&r, "value");
+    if ((kts < 0) || (kval < 0)) {
+	fprintf(stderr, "%s: missing columns\n", file);
+	exit(1);
+    }
+    rows = 0;
+    for (g = 0; g < r.ngroups; g++) {
+	nrows += r.nrows[g];
+	if (r.nrows[g] > rows)
+	    rows = r.nrows[g];
+    }
+    printf("%s: %.2f GB, %llu rows, %zu groups, %.2f GB unpacked\n", file,
+	   r.size / 1e9, (unsigned long long) nrows, r.ngroups,
+	   nrows * r.ncols * 4 / 1e9);
+    out = (uint32_t*) malloc(rows * sizeof(uint32_t));
+    bm = (uint8_t*) malloc((rows + 7) / 8);
+
+    // full scan
+    t = now();
+    sum = 0;
+    bytes = 0;
+    for (g = 0; g < r.ngroups; g++) {
+	for (k = 0; k < r.ncols; k++) {
+	    long n = bitfile_read(&r, g, k, out), j;
+	    for (j = 0; j < n; j++)
+		sum += out[j];
+	    bytes += bitfile_block(&r, g, k)->size;
+	}
+    }
+    report("full", now() - t, nrows, bytes, r.ngroups, r.ngroups, sum);
+
+    // projection
+    t = now();
+    sum = 0;
+    bytes = 0;
+    for (g = 0; g < r.ngroups; g++) {
+	long n = bitfile_read(&r, g, kval, out), j;
+	for (j = 0; j < n; j++)
+	    sum += out[j];
+	bytes += bitfile_block(&r, g, kval)->size;
+    }
+    report("project", now() - t, nrows, bytes, r.ngroups, r.ngroups, sum);
+
+    // filter on 1% of the time stamp range in the middle
+    tmax = bitfile_block(&r, r.ngroups-1, kts)->max;
+    lo = tmax / 2;
+    hi = lo + tmax / 100;
+    t = now();
+    sum = 0;
+    bytes = 0;
+    read = 0;
+    for (g = 0; g < r.ngroups; g++) {
+	long n, j;
+	if (bitfile_skip(&r, g, kts, lo, hi))
+	    continue;
+	bitfile_select(&r, g, kts, lo, hi, bm);
+	n = bitfile_read_sel(&r, g, kval, bm, out);
+	for (j = 0; j < n; j++)
+	    sum += out[j];
+	bytes += bitfile_block(&r, g, kts)->size +
+	    bitfile_block(&r, g, kval)->size;
+	read++;
+    }
+    report("filter", now() - t, nrows, bytes, read, r.ngroups, sum);
+
+    free(out);
+    free(bm);
+    bitfile_close(&r);
+    exit(0);
+}
@@ -0,0 +1,632 @@
+//
+// bitgen - generate specialized pack/unpack functions from a layout
+//
+// Build: gcc -O2 -o bitgen bitgen.c
+//
+// Usage: bitgen [-h | -t | -b] [-i header] layout-file
+//   -h          emit header with structs and pack/unpack (default)
+//   -t          emit round-trip test against set_bits/get_bits,
+//               define BITGEN_NO_MAIN to include it in another program
+//   -b          emit micro benchmark against set_bits/get_bits
+//   -i header   header name included by -t and -b output
+//
+// Layout file:
+//
+//   # comment
+//   message can_std be        # le or be fill order (default le)
+//     id      11              # name width
+//     rtr     1
+//     len     4
+//     data    8 [8]           # array of 8 elements
+//     temp    @80 12 signed   # explicit bit offset
+//   end
+//
+// Fields without @offset follow the previous field. Width is 1..64.
+// All masks and shifts are constant folded, fields are merged into
+// 64-bit word loads and stores (bytes in the last partial word are
+// accessed one by one).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+
+#define MAX_NAME 64
+
+typedef struct {
+    char name[MAX_NAME];
+    int  offset;   // bit offset of first element
+    int  width;    // bits per element
+    int  count;    // array size, 0 for scalar
+    int  sign;     // signed value
+} field_t;
+
+typedef struct {
+    char     name[MAX_NAME];
+    int      be;        // big endian fill order
+    int      nbits;     // message size in bits
+    int      nfields;
+    field_t* field;
+} message_t;
+
+static message_t* msgs = NULL;
+static int nmsgs = 0;
+
+static void fatal(const char* file, int line, const char* msg)
+{
+    fprintf(stderr, "%s:%d: %s\n", file, line, msg);
+    exit(1);
+}
+
+// parse a non-negative decimal int ending at term, -1 if not one
+static int number(const char* s, char term)
+{
+    char* end;
+    long v;
+
+    if (!isdigit((unsigned char)*s))
+	return -1;
+    errno = 0;
+    v = strtol(s, &end, 10);
+    if ((errno != 0) || (v > INT_MAX) || (*end != term) ||
+	((term != '\0') && (end[1] != '\0')))
+	return -1;
+    return (int) v;
+}
+
+static int valid_name(const char* s)
+{
+    if (!isalpha((unsigned char)*s) && (*s != '_'))
+	return 0;
+    while (*++s) {
+	if (!isalnum((unsigned char)*s) && (*s != '_'))
+	    return 0;
+    }
+    return 1;
+}
+
+static void parse(const char* file)
+{
+    FILE* f;
+    char buf[1024];
+    int line = 0;
+    message_t* m = NULL;
+    int next = 0;   // next sequential offset
+
+    if ((f = fopen(file, "r")) == NULL) {
+	perror(file);
+	exit(1);
+    }
+    while (fgets(buf, sizeof(buf), f)) {
+	char* tok[8];
+	int ntok = 0;
+	char* p;
+
+	line++;
+	if ((p = strchr(buf, '#')) != NULL)
+	    *p = '\0';
+	for (p = strtok(buf, " \t\r\n"); p && (ntok < 8);
+	     p = strtok(NULL, " \t\r\n"))
+	    tok[ntok++] = p;
+	if (ntok == 0)
+	    continue;
+
+	if (strcmp(tok[0], "message") == 0) {
+	    if (m)
+		fatal(file, line, "missing end");
+	    if ((ntok < 2) || (ntok > 3) || !valid_name(tok[1]) ||
+		(strlen(tok[1]) >= MAX_NAME))
+		fatal(file, line, "bad message name");
+	    msgs = (message_t*) realloc(msgs, (nmsgs+1)*sizeof(message_t));
+	    m = &msgs[nmsgs++];
+	    memset(m, 0, sizeof(message_t));
+	    strcpy(m->name, tok[1]);
+	    if (ntok == 3) {
+		if (strcmp(tok[2], "be") == 0)
+		    m->be = 1;
+		else if (strcmp(tok[2], "le") != 0)
+		    fatal(file, line, "expected le or be");
+	    }
+	    next = 0;
+	}
+	else if (strcmp(tok[0], "end") == 0) {
+	    if (!m)
+		fatal(file, line, "end without message");
+	    m = NULL;
+	}
+	else {
+	    field_t fld;
+	    int t = 1;
+	    int k, n;
+
+	    if (!m)
+		fatal(file, line, "field outside message");
+	    if (!valid_name(tok[0]) || (strlen(tok[0]) >= MAX_NAME))
+		fatal(file, line, "bad field name");
+	    memset(&fld, 0, sizeof(fld));
+	    strcpy(fld.name, tok[0]);
+	    fld.offset = next;
+	    if ((t < ntok) && (tok[t][0] == '@')) {
+		if ((fld.offset = number(tok[t++]+1, '\0')) < 0)
+		    fatal(file, line, "offset must be a non-negative integer");
+	    }
+	    if ((t >= ntok) || !isdigit((unsigned char)tok[t][0]))
+		fatal(file, line, "missing width");
+	    fld.width = number(tok[t++], '\0');
+	    if ((fld.width < 1) || (fld.width > 64))
+		fatal(file, line, "width must be 1..64");
+	    for (; t < ntok; t++) {
+		if (strcmp(tok[t], "signed") == 0)
+		    fld.sign = 1;
+		else if (strcmp(tok[t], "unsigned") == 0)
+		    fld.sign = 0;
+		else if ((tok[t][0] == '[') && ((fld.count = number(tok[t]+1, ']')) > 0))
+		    ;
+		else
+		    fatal(file, line, "bad field attribute");
+	    }
+	    if ((int64_t) fld.width * (fld.count ? fld.count : 1) >
+		INT_MAX - fld.offset)
+		fatal(file, line, "field too large");
+	    n = fld.width * (fld.count ? fld.count : 1);
+	    // check for overlap with earlier fields
+	    for (k = 0; k < m->nfields; k++) {
+		field_t* g = &m->field[k];
+		int gn = g->width * (g->count ? g->count : 1);
+		if ((fld.offset < g->offset + gn) && (g->offset < fld.offset + n))
+		    fatal(file, line, "field overlap");
+		if (strcmp(g->name, fld.name) == 0)
+		    fatal(file, line, "duplicate field");
+	    }
+	    m->field = (field_t*) realloc(m->field,
+					  (m->nfields+1)*sizeof(field_t));
+	    m->field[m->nfields++] = fld;
+	    next = fld.offset + n;
+	    if (next > m->nbits)
+		m->nbits = next;
+	}
+    }
+    if (m)
+	fatal(file, line, "missing end");
+    fclose(f);
+}
+
+static const char* ctype(const field_t* f)
+{
+    int w = (f->width <= 8) ? 8 : (f->width <= 16) ? 16 :
+	(f->width <= 32) ? 32 : 64;
+    static char buf[16];
+    sprintf(buf, "%sint%d_t", f->sign ? "" : "u", w);
+    return buf;
+}
+
+static uint64_t mask64(int lo, int hi)  // bits lo .. hi-1
+{
+    uint64_t m = (hi >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << hi) - 1);
+    return m & ~(((uint64_t)1 << lo) - 1);
+}
+
+// element access expression
+static void elem(char* buf, const char* sep, const field_t* f, int i)
+{
+    if (f->count)
+	sprintf(buf, "m%s%s[%d]", sep, f->name, i);
+    else
+	sprintf(buf, "m%s%s", sep, f->name);
+}
+
+//
+// the part of element (o, w) in word q: word bit = value bit + sh
+// restricted to word bits lo .. hi-1. returns 0 if not in word.
+//
+static int part(const message_t* m, int o, int w, int q,
+		int* sh, int* lo, int* hi)
+{
+    int a = (o > 64*q) ? o : 64*q;
+    int b = (o+w < 64*q+64) ? o+w : 64*q+64;
+
+    if (a >= b)
+	return 0;
+    if (m->be) {
+	*sh = 64*(q+1) - o - w;
+	*lo = 64 - (b - 64*q);
+	*hi = 64 - (a - 64*q);
+    }
+    else {
+	*sh = o - 64*q;
+	*lo = a - 64*q;
+	*hi = b - 64*q;
+    }
+    return 1;
+}
+
+// check if any field has bits in word q
+static int word_used(const message_t* m, int q)
+{
+    int k, e, sh, lo, hi;
+
+    for (k = 0; k < m->nfields; k++) {
+	const field_t* f = &m->field[k];
+	int n = f->count ? f->count : 1;
+	for (e = 0; e < n; e++) {
+	    if (part(m, f->offset + e*f->width, f->width, q, &sh, &lo, &hi))
+		return 1;
+	}
+    }
+    return 0;
+}
+
+static void emit_shift(FILE* out, const char* x, int sh)
+{
+    if (sh > 0)
+	fprintf(out, "(%s << %d)", x, sh);
+    else if (sh < 0)
+	fprintf(out, "(%s >> %d)", x, -sh);
+    else
+	fprintf(out, "%s", x);
+}
+
+static void emit_header(FILE* out)
+{
+    int i;
+
+    fprintf(out, "//\n// generated by bitgen, do not edit\n//\n\n");
+    fprintf(out, "#include \"bitpack.h\"\n\n");
+    for (i = 0; i < nmsgs; i++) {
+	message_t* m = &msgs[i];
+	int nbytes = (m->nbits + 7) >> 3;
+	int nwords = (nbytes + 7) >> 3;
+	char ename[MAX_NAME+16];
+	int k, e, q;
+
+	fprintf(out, "typedef struct {\n");
+	for (k = 0; k < m->nfields; k++) {
+	    field_t* f = &m->field[k];
+	    if (f->count)
+		fprintf(out, "    %s %s[%d];\n", ctype(f), f->name, f->count);
+	    else
+		fprintf(out, "    %s %s;\n", ctype(f), f->name);
+	}
+	fprintf(out, "} %s_t;\n\n", m->name);
+	fprintf(out, "#define %s_BITS %d\n", m->name, m->nbits);
+	fprintf(out, "#define %s_SIZE %d\n\n", m->name, nbytes);
+
+	// pack
+	fprintf(out, "static inline void %s_pack(uint8_t* ptr, "
+		"const %s_t* m)\n{\n", m->name, m->name);
+	for (q = 0; q < nwords; q++) {
+	    int tail = (8*q + 8 > nbytes);
+	    uint64_t wmask = 0;
+
+	    if (!word_used(m, q))
+		continue;
+	    fprintf(out, "    {\n\tuint64_t x = 0");
+	    for (k = 0; k < m->nfields; k++) {
+		field_t* f = &m->field[k];
+		int n = f->count ? f->count : 1;
+		for (e = 0; e < n; e++) {
+		    int sh, lo, hi;
+		    char x[MAX_NAME+32];
+		    if (!part(m, f->offset + e*f->width, f->width, q,
+			      &sh, &lo, &hi))
+			continue;
+		    elem(ename, "->", f, e);
+		    sprintf(x, "(uint64_t) %s", ename);
+		    fprintf(out, "\n\t    | (");
+		    emit_shift(out, x, sh);
+		    fprintf(out, " & 0x%016llxULL)",
+			    (unsigned long long) mask64(lo, hi));
+		    wmask |= mask64(lo, hi);
+		}
+	    }
+	    fprintf(out, ";\n");
+	    if (!tail) {
+		const char* en = m->be ? "be" : "le";
+		if (wmask == ~(uint64_t)0)
+		    fprintf(out, "\tstore_%s64(ptr+%d, x);\n", en, 8*q);
+		else
+		    fprintf(out, "\tstore_%s64(ptr+%d, (load_%s64(ptr+%d) & "
+			    "0x%016llxULL) | x);\n", en, 8*q, en, 8*q,
+			    (unsigned long long) ~wmask);
+	    }
+	    else {
+		int b;
+		for (b = 0; 8*q + b < nbytes; b++) {
+		    int s = m->be ? (56 - 8*b) : 8*b;
+		    unsigned mb = (wmask >> s) & 0xff;
+		    if (mb == 0xff)
+			fprintf(out, "\tptr[%d] = (uint8_t) (x >> %d);\n",
+				8*q+b, s);
+		    else if (mb)
+			fprintf(out, "\tptr[%d] = (ptr[%d] & 0x%02x) | "
+				"((uint8_t) (x >> %d) & 0x%02x);\n",
+				8*q+b, 8*q+b, (~mb) & 0xff, s, mb);
+		}
+	    }
+	    fprintf(out, "    }\n");
+	}
+	fprintf(out, "}\n\n");
+
+	// unpack
+	fprintf(out, "static inline void %s_unpack(const uint8_t* ptr, "
+		"%s_t* m)\n{\n", m->name, m->name);
+	for (q = 0; q < nwords; q++) {
+	    if (!word_used(m, q))
+		continue;
+	    if (8*q + 8 <= nbytes)
+		fprintf(out, "    uint64_t w%d = load_%s64(ptr+%d);\n",
+			q, m->be ? "be" : "le", 8*q);
+	    else {
+		int b;
+		fprintf(out, "    uint64_t w%d = 0", q);
+		for (b = 0; 8*q + b < nbytes; b++)
+		    fprintf(out, "\n\t| ((uint64_t) ptr[%d] << %d)",
+			    8*q+b, m->be ? (56 - 8*b) : 8*b);
+		fprintf(out, ";\n");
+	    }
+	}
+	for (k = 0; k < m->nfields; k++) {
+	    field_t* f = &m->field[k];
+	    int n = f->count ? f->count : 1;
+	    for (e = 0; e < n; e++) {
+		int o = f->offset + e*f->width;
+		int first = 1;
+		elem(ename, "->", f, e);
+		fprintf(out, "    %s = ", ename);
+		if (f->sign)
+		    fprintf(out, "(%s) ((int64_t) ((", ctype(f));
+		else
+		    fprintf(out, "(%s) (", ctype(f));
+		for (q = o >> 6; q <= (o + f->width - 1) >> 6; q++) {
+		    int sh, lo, hi;
+		    char x[16];
+		    if (!part(m, o, f->width, q, &sh, &lo, &hi))
+			continue;
+		    sprintf(x, "w%d", q);
+		    if (!first)
+			fprintf(out, " | ");
+		    fprintf(out, "(");
+		    emit_shift(out, x, -sh);
+		    fprintf(out, " & 0x%016llxULL)",
+			    (unsigned long long) mask64(lo - sh, hi - sh));
+		    first = 0;
+		}
+		if (f->sign)
+		    fprintf(out, ") << %d) >> %d);\n",
+			    64 - f->width, 64 - f->width);
+		else
+		    fprintf(out, ");\n");
+	    }
+	}
+	fprintf(out, "}\n\n");
+    }
+}
+
+// generic pack/unpack with set_bits/get_bits, used by test and bench
+static void emit_generic(FILE* out)
+{
+    int i, k;
+
+    for (i = 0; i < nmsgs; i++) {
+	message_t* m = &msgs[i];
+	const char* en = m->be ? "be" : "le";
+
+	fprintf(out, "static void %s_pack_generic(uint8_t* ptr, "
+		"const %s_t* m)\n{\n", m->name, m->name);
+	for (k = 0; k < m->nfields; k++) {
+	    field_t* f = &m->field[k];
+	    uint64_t mask = mask64(0, f->width);
+	    if (f->count)
+		fprintf(out, "    { int e; for (e = 0; e < %d; e++) "
+			"set_bits_%s64(ptr, (uint64_t) m->%s[e] & "
+			"0x%llxULL, %d + e*%d, %d); }\n",
+			f->count, en, f->name, (unsigned long long) mask,
+			f->offset, f->width, f->width);
+	    else
+		fprintf(out, "    set_bits_%s64(ptr, (uint64_t) m->%s & "
+			"0x%llxULL, %d, %d);\n", en, f->name,
+			(unsigned long long) mask, f->offset, f->width);
+	}
+	fprintf(out, "}\n\n");
+
+	fprintf(out, "static void %s_unpack_generic(const uint8_t* ptr, "
+		"%s_t* m)\n{\n    uint64_t v;\n", m->name, m->name);
+	for (k = 0; k < m->nfields; k++) {
+	    field_t* f = &m->field[k];
+	    char lhs[MAX_NAME+16];
+	    char sx[128];
+	    if (f->sign)
+		sprintf(sx, "(%s) (((int64_t) (v << %d)) >> %d)",
+			ctype(f), 64 - f->width, 64 - f->width);
+	    else
+		sprintf(sx, "(%s) v", ctype(f));
+	    if (f->count) {
+		sprintf(lhs, "m->%s[e]", f->name);
+		fprintf(out, "    { int e; for (e = 0; e < %d; e++) { "
+			"get_bits_%s64(ptr, &v, %d + e*%d, %d); %s = %s; } }\n",
+			f->count, en, f->offset, f->width, f->width, lhs, sx);
+	    }
+	    else {
+		sprintf(lhs, "m->%s", f->name);
+		fprintf(out, "    get_bits_%s64(ptr, &v, %d, %d); %s = %s;\n",
+			en, f->offset, f->width, lhs, sx);
+	    }
+	}
+	fprintf(out, "}\n\n");
+    }
+}
+
+static void emit_random(FILE* out, const message_t* m)
+{
+    int k;
+    fprintf(out, "static void %s_random(%s_t* m)\n{\n", m->name, m->name);
+    for (k = 0; k < m->nfields; k++) {
+	const field_t* f = &m->field[k];
+	char lhs[MAX_NAME+16];
+	if (f->count)
+	    sprintf(lhs, "m->%s[e]", f->name);
+	else
+	    elem(lhs, "->", f, 0);
+	if (f->count)
+	    fprintf(out, "    { int e; for (e = 0; e < %d; e++) ", f->count);
+	else
+	    fprintf(out, "    ");
+	if (f->sign)
+	    fprintf(out, "%s = (%s) (((int64_t) (rnd64() << %d)) >> %d);",
+		    lhs, ctype(f), 64 - f->width, 64 - f->width);
+	else
+	    fprintf(out, "%s = (%s) (rnd64() & 0x%llxULL);", lhs, ctype(f),
+		    (unsigned long long) mask64(0, f->width));
+	fprintf(out, f->count ? " }\n" : "\n");
+    }
+    fprintf(out, "}\n\n");
+}
+
+static void emit_equal(FILE* out, const message_t* m)
+{
+    int k;
+    fprintf(out, "static int %s_equal(const %s_t* a, const %s_t* b)\n{\n",
+	    m->name, m->name, m->name);
+    for (k = 0; k < m->nfields; k++) {
+	const field_t* f = &m->field[k];
+	if (f->count)
+	    fprintf(out, "    { int e; for (e = 0; e < %d; e++) "
+		    "if (a->%s[e] != b->%s[e]) return 0; }\n",
+		    f->count, f->name, f->name);
+	else
+	    fprintf(out, "    if (a->%s != b->%s) return 0;\n",
+		    f->name, f->name);
+    }
+    fprintf(out, "    return 1;\n}\n\n");
+}
+
+static void emit_prelude(FILE* out, const char* header)
+{
+    fprintf(out, "//\n// generated by bitgen, do not edit\n//\n\n");
+    fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n"
+	    "#include <string.h>\n#include <time.h>\n\n");
+    fprintf(out, "#include \"%s\"\n\n", header);
+    fprintf(out, "static uint64_t rnd64(void)\n{\n"
+	    "    return ((uint64_t) random() << 42) ^ "
+	    "((uint64_t) random() << 21) ^ random();\n}\n\n");
+    emit_generic(out);
+}
+
+static void emit_test(FILE* out, const char* header)
+{
+    int i;
+
+    emit_prelude(out, header);
+    for (i = 0; i < nmsgs; i++) {
+	emit_random(out, &msgs[i]);
+	emit_equal(out, &msgs[i]);
+    }
+    fprintf(out, "static void bitgen_round_trip(int n)\n{\n    int j;\n\n");
+    for (i = 0; i < nmsgs; i++) {
+	const char* n = msgs[i].name;
+	fprintf(out,
+		"    for (j = 0; j < n; j++) {\n"
+		"\tuint8_t a[%s_SIZE], b[%s_SIZE];\n"
+		"\t%s_t m, m1, m2;\n"
+		"\tint k;\n"
+		"\tfor (k = 0; k < %s_SIZE; k++)\n"
+		"\t    a[k] = b[k] = random();\n"
+		"\t%s_random(&m);\n"
+		"\t%s_pack(a, &m);\n"
+		"\t%s_pack_generic(b, &m);\n"
+		"\t%s_unpack(a, &m1);\n"
+		"\t%s_unpack_generic(b, &m2);\n"
+		"\tif (memcmp(a, b, sizeof(a)) || !%s_equal(&m, &m1) ||\n"
+		"\t    !%s_equal(&m, &m2)) {\n"
+		"\t    fprintf(stderr, \"FAIL: %s\\n\");\n"
+		"\t    exit(1);\n"
+		"\t}\n"
+		"    }\n", n, n, n, n, n, n, n, n, n, n, n, n);
+    }
+    fprintf(out, "}\n\n");
+    // main can be left out to call the test from another program
+    fprintf(out, "#ifndef BITGEN_NO_MAIN\n"
+	    "int main()\n{\n    bitgen_round_trip(10000);\n    exit(0);\n}\n"
+	    "#endif\n");
+}
+
+static void emit_bench(FILE* out, const char* header)
+{
+    int i;
+
+    emit_prelude(out, header);
+    for (i = 0; i < nmsgs; i++)
+	emit_random(out, &msgs[i]);
+    fprintf(out,
+	    "#define ITER 10000000\n\n"
+	    "static double now(void)\n{\n"
+	    "    struct timespec ts;\n"
+	    "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+	    "    return ts.tv_sec + ts.tv_nsec*1e-9;\n}\n\n"
+	    "int main()\n{\n"
+	    "    volatile uint8_t sink = 0;\n"
+	    "    double t0, t1, t2;\n"
+	    "    int j;\n\n");
+    for (i = 0; i < nmsgs; i++) {
+	const char* n = msgs[i].name;
+	fprintf(out,
+		"    {\n"
+		"\tuint8_t buf[%s_SIZE];\n"
+		"\t%s_t m;\n"
+		"\tmemset(buf, 0, sizeof(buf));\n"
+		"\t%s_random(&m);\n"
+		"\tt0 = now();\n"
+		"\tfor (j = 0; j < ITER; j++) {\n"
+		"\t    %s_pack(buf, &m);\n"
+		"\t    %s_unpack(buf, &m);\n"
+		"\t    sink ^= buf[j %% %s_SIZE];\n"
+		"\t}\n"
+		"\tt1 = now();\n"
+		"\tfor (j = 0; j < ITER; j++) {\n"
+		"\t    %s_pack_generic(buf, &m);\n"
+		"\t    %s_unpack_generic(buf, &m);\n"
+		"\t    sink ^= buf[j %% %s_SIZE];\n"
+		"\t}\n"
+		"\tt2 = now();\n"
+		"\tprintf(\"%%-24s generated %%6.2f ns  generic %%6.2f ns\\n\",\n"
+		"\t       \"%s\", (t1-t0)*1e9/ITER, (t2-t1)*1e9/ITER);\n"
+		"    }\n", n, n, n, n, n, n, n, n, n, n);
+    }
+    fprintf(out, "    (void) sink;\n    exit(0);\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+    int mode = 'h';
+    const char* header = "bitgen_out.h";
+    const char* file = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+	if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "-t") == 0) ||
+	    (strcmp(argv[i], "-b") == 0))
+	    mode = argv[i][1];
+	else if ((strcmp(argv[i], "-i") == 0) && (i+1 < argc))
+	    header = argv[++i];
+	else if (argv[i][0] != '-')
+	    file = argv[i];
+	else
+	    file = NULL, i = argc;
+    }
+    if (!file) {
+	fprintf(stderr, "usage: bitgen [-h | -t | -b] [-i header] "
+		"layout-file\n");
+	exit(1);
+    }
+    parse(file);
+    switch(mode) {
+    case 'h': emit_header(stdout); break;
+    case 't': emit_test(stdout, header); break;
+    case 'b': emit_bench(stdout, header); break;
+    }
+    exit(0);
+}
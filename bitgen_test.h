@@ -0,0 +1,204 @@
+//
+// generated by bitgen, do not edit
+//
+
+#include "bitpack.h"
+
+typedef struct {
+    uint8_t sof;
+    uint16_t id;
+    uint8_t rtr;
+    uint8_t ide;
+    uint8_t r0;
+    uint8_t dlc;
+    uint8_t data[8];
+    uint16_t crc;
+} can_std_t;
+
+#define can_std_BITS 98
+#define can_std_SIZE 13
+
+static inline void can_std_pack(uint8_t* ptr, const can_std_t* m)
+{
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->sof << 63) & 0x8000000000000000ULL)
+	    | (((uint64_t) m->id << 52) & 0x7ff0000000000000ULL)
+	    | (((uint64_t) m->rtr << 51) & 0x0008000000000000ULL)
+	    | (((uint64_t) m->ide << 50) & 0x0004000000000000ULL)
+	    | (((uint64_t) m->r0 << 49) & 0x0002000000000000ULL)
+	    | (((uint64_t) m->dlc << 45) & 0x0001e00000000000ULL)
+	    | (((uint64_t) m->data[0] << 37) & 0x00001fe000000000ULL)
+	    | (((uint64_t) m->data[1] << 29) & 0x0000001fe0000000ULL)
+	    | (((uint64_t) m->data[2] << 21) & 0x000000001fe00000ULL)
+	    | (((uint64_t) m->data[3] << 13) & 0x00000000001fe000ULL)
+	    | (((uint64_t) m->data[4] << 5) & 0x0000000000001fe0ULL)
+	    | (((uint64_t) m->data[5] >> 3) & 0x000000000000001fULL);
+	store_be64(ptr+0, x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->data[5] << 61) & 0xe000000000000000ULL)
+	    | (((uint64_t) m->data[6] << 53) & 0x1fe0000000000000ULL)
+	    | (((uint64_t) m->data[7] << 45) & 0x001fe00000000000ULL)
+	    | (((uint64_t) m->crc << 30) & 0x00001fffc0000000ULL);
+	ptr[8] = (uint8_t) (x >> 56);
+	ptr[9] = (uint8_t) (x >> 48);
+	ptr[10] = (uint8_t) (x >> 40);
+	ptr[11] = (uint8_t) (x >> 32);
+	ptr[12] = (ptr[12] & 0x3f) | ((uint8_t) (x >> 24) & 0xc0);
+    }
+}
+
+static inline void can_std_unpack(const uint8_t* ptr, can_std_t* m)
+{
+    uint64_t w0 = load_be64(ptr+0);
+    uint64_t w1 = 0
+	| ((uint64_t) ptr[8] << 56)
+	| ((uint64_t) ptr[9] << 48)
+	| ((uint64_t) ptr[10] << 40)
+	| ((uint64_t) ptr[11] << 32)
+	| ((uint64_t) ptr[12] << 24);
+    m->sof = (uint8_t) (((w0 >> 63) & 0x0000000000000001ULL));
+    m->id = (uint16_t) (((w0 >> 52) & 0x00000000000007ffULL));
+    m->rtr = (uint8_t) (((w0 >> 51) & 0x0000000000000001ULL));
+    m->ide = (uint8_t) (((w0 >> 50) & 0x0000000000000001ULL));
+    m->r0 = (uint8_t) (((w0 >> 49) & 0x0000000000000001ULL));
+    m->dlc = (uint8_t) (((w0 >> 45) & 0x000000000000000fULL));
+    m->data[0] = (uint8_t) (((w0 >> 37) & 0x00000000000000ffULL));
+    m->data[1] = (uint8_t) (((w0 >> 29) & 0x00000000000000ffULL));
+    m->data[2] = (uint8_t) (((w0 >> 21) & 0x00000000000000ffULL));
+    m->data[3] = (uint8_t) (((w0 >> 13) & 0x00000000000000ffULL));
+    m->data[4] = (uint8_t) (((w0 >> 5) & 0x00000000000000ffULL));
+    m->data[5] = (uint8_t) (((w0 << 3) & 0x00000000000000f8ULL) | ((w1 >> 61) & 0x0000000000000007ULL));
+    m->data[6] = (uint8_t) (((w1 >> 53) & 0x00000000000000ffULL));
+    m->data[7] = (uint8_t) (((w1 >> 45) & 0x00000000000000ffULL));
+    m->crc = (uint16_t) (((w1 >> 30) & 0x0000000000007fffULL));
+}
+
+typedef struct {
+    uint8_t type;
+    uint8_t chan;
+    int16_t temp;
+    int16_t accel[3];
+    uint64_t stamp;
+    uint8_t flags;
+    uint64_t wide;
+    int8_t tail;
+} sensor_t;
+
+#define sensor_BITS 193
+#define sensor_SIZE 25
+
+static inline void sensor_pack(uint8_t* ptr, const sensor_t* m)
+{
+    {
+	uint64_t x = 0
+	    | ((uint64_t) m->type & 0x0000000000000007ULL)
+	    | (((uint64_t) m->chan << 3) & 0x00000000000000f8ULL)
+	    | (((uint64_t) m->temp << 8) & 0x00000000000fff00ULL)
+	    | (((uint64_t) m->accel[0] << 20) & 0x00000003fff00000ULL)
+	    | (((uint64_t) m->accel[1] << 34) & 0x0000fffc00000000ULL)
+	    | (((uint64_t) m->accel[2] << 48) & 0x3fff000000000000ULL)
+	    | (((uint64_t) m->stamp << 62) & 0xc000000000000000ULL);
+	store_le64(ptr+0, x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->stamp >> 2) & 0x0000003fffffffffULL)
+	    | (((uint64_t) m->flags << 56) & 0x0f00000000000000ULL)
+	    | (((uint64_t) m->wide << 60) & 0xf000000000000000ULL);
+	store_le64(ptr+8, (load_le64(ptr+8) & 0x00ffffc000000000ULL) | x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->wide >> 4) & 0x0fffffffffffffffULL)
+	    | (((uint64_t) m->tail << 60) & 0xf000000000000000ULL);
+	store_le64(ptr+16, x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->tail >> 4) & 0x0000000000000001ULL);
+	ptr[24] = (ptr[24] & 0xfe) | ((uint8_t) (x >> 0) & 0x01);
+    }
+}
+
+static inline void sensor_unpack(const uint8_t* ptr, sensor_t* m)
+{
+    uint64_t w0 = load_le64(ptr+0);
+    uint64_t w1 = load_le64(ptr+8);
+    uint64_t w2 = load_le64(ptr+16);
+    uint64_t w3 = 0
+	| ((uint64_t) ptr[24] << 0);
+    m->type = (uint8_t) ((w0 & 0x0000000000000007ULL));
+    m->chan = (uint8_t) (((w0 >> 3) & 0x000000000000001fULL));
+    m->temp = (int16_t) ((int64_t) ((((w0 >> 8) & 0x0000000000000fffULL)) << 52) >> 52);
+    m->accel[0] = (int16_t) ((int64_t) ((((w0 >> 20) & 0x0000000000003fffULL)) << 50) >> 50);
+    m->accel[1] = (int16_t) ((int64_t) ((((w0 >> 34) & 0x0000000000003fffULL)) << 50) >> 50);
+    m->accel[2] = (int16_t) ((int64_t) ((((w0 >> 48) & 0x0000000000003fffULL)) << 50) >> 50);
+    m->stamp = (uint64_t) (((w0 >> 62) & 0x0000000000000003ULL) | ((w1 << 2) & 0x000000fffffffffcULL));
+    m->flags = (uint8_t) (((w1 >> 56) & 0x000000000000000fULL));
+    m->wide = (uint64_t) (((w1 >> 60) & 0x000000000000000fULL) | ((w2 << 4) & 0xfffffffffffffff0ULL));
+    m->tail = (int8_t) ((int64_t) ((((w2 >> 60) & 0x000000000000000fULL) | ((w3 << 4) & 0x0000000000000010ULL)) << 59) >> 59);
+}
+
+typedef struct {
+    uint8_t a;
+    int32_t b;
+    uint64_t c;
+    uint8_t d;
+    int32_t e[4];
+} mixed_t;
+
+#define mixed_BITS 162
+#define mixed_SIZE 21
+
+static inline void mixed_pack(uint8_t* ptr, const mixed_t* m)
+{
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->a << 54) & 0x1fc0000000000000ULL)
+	    | (((uint64_t) m->b << 24) & 0x003fffffff000000ULL)
+	    | (((uint64_t) m->c >> 29) & 0x000000000000000fULL);
+	store_be64(ptr+0, (load_be64(ptr+0) & 0xe000000000fffff0ULL) | x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->c << 35) & 0xfffffff800000000ULL)
+	    | (((uint64_t) m->d << 34) & 0x0000000400000000ULL)
+	    | (((uint64_t) m->e[0] << 17) & 0x00000003fffe0000ULL)
+	    | ((uint64_t) m->e[1] & 0x000000000001ffffULL);
+	store_be64(ptr+8, x);
+    }
+    {
+	uint64_t x = 0
+	    | (((uint64_t) m->e[2] << 47) & 0xffff800000000000ULL)
+	    | (((uint64_t) m->e[3] << 30) & 0x00007fffc0000000ULL);
+	ptr[16] = (uint8_t) (x >> 56);
+	ptr[17] = (uint8_t) (x >> 48);
+	ptr[18] = (uint8_t) (x >> 40);
+	ptr[19] = (uint8_t) (x >> 32);
+	ptr[20] = (ptr[20] & 0x3f) | ((uint8_t) (x >> 24) & 0xc0);
+    }
+}
+
+static inline void mixed_unpack(const uint8_t* ptr, mixed_t* m)
+{
+    uint64_t w0 = load_be64(ptr+0);
+    uint64_t w1 = load_be64(ptr+8);
+    uint64_t w2 = 0
+	| ((uint64_t) ptr[16] << 56)
+	| ((uint64_t) ptr[17] << 48)
+	| ((uint64_t) ptr[18] << 40)
+	| ((uint64_t) ptr[19] << 32)
+	| ((uint64_t) ptr[20] << 24);
+    m->a = (uint8_t) (((w0 >> 54) & 0x000000000000007fULL));
+    m->b = (int32_t) ((int64_t) ((((w0 >> 24) & 0x000000003fffffffULL)) << 34) >> 34);
+    m->c = (uint64_t) (((w0 << 29) & 0x00000001e0000000ULL) | ((w1 >> 35) & 0x000000001fffffffULL));
+    m->d = (uint8_t) (((w1 >> 34) & 0x0000000000000001ULL));
+    m->e[0] = (int32_t) ((int64_t) ((((w1 >> 17) & 0x000000000001ffffULL)) << 47) >> 47);
+    m->e[1] = (int32_t) ((int64_t) (((w1 & 0x000000000001ffffULL)) << 47) >> 47);
+    m->e[2] = (int32_t) ((int64_t) ((((w2 >> 47) & 0x000000000001ffffULL)) << 47) >> 47);
+    m->e[3] = (int32_t) ((int64_t) ((((w2 >> 30) & 0x000000000001ffffULL)) << 47) >> 47);
+}
+
@@ -0,0 +1,218 @@
+//
+// generated by bitgen, do not edit
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitgen_test.h"
+
+static uint64_t rnd64(void)
+{
+    return ((uint64_t) random() << 42) ^ ((uint64_t) random() << 21) ^ random();
+}
+
+static void can_std_pack_generic(uint8_t* ptr, const can_std_t* m)
+{
+    set_bits_be64(ptr, (uint64_t) m->sof & 0x1ULL, 0, 1);
+    set_bits_be64(ptr, (uint64_t) m->id & 0x7ffULL, 1, 11);
+    set_bits_be64(ptr, (uint64_t) m->rtr & 0x1ULL, 12, 1);
+    set_bits_be64(ptr, (uint64_t) m->ide & 0x1ULL, 13, 1);
+    set_bits_be64(ptr, (uint64_t) m->r0 & 0x1ULL, 14, 1);
+    set_bits_be64(ptr, (uint64_t) m->dlc & 0xfULL, 15, 4);
+    { int e; for (e = 0; e < 8; e++) set_bits_be64(ptr, (uint64_t) m->data[e] & 0xffULL, 19 + e*8, 8); }
+    set_bits_be64(ptr, (uint64_t) m->crc & 0x7fffULL, 83, 15);
+}
+
+static void can_std_unpack_generic(const uint8_t* ptr, can_std_t* m)
+{
+    uint64_t v;
+    get_bits_be64(ptr, &v, 0, 1); m->sof = (uint8_t) v;
+    get_bits_be64(ptr, &v, 1, 11); m->id = (uint16_t) v;
+    get_bits_be64(ptr, &v, 12, 1); m->rtr = (uint8_t) v;
+    get_bits_be64(ptr, &v, 13, 1); m->ide = (uint8_t) v;
+    get_bits_be64(ptr, &v, 14, 1); m->r0 = (uint8_t) v;
+    get_bits_be64(ptr, &v, 15, 4); m->dlc = (uint8_t) v;
+    { int e; for (e = 0; e < 8; e++) { get_bits_be64(ptr, &v, 19 + e*8, 8); m->data[e] = (uint8_t) v; } }
+    get_bits_be64(ptr, &v, 83, 15); m->crc = (uint16_t) v;
+}
+
+static void sensor_pack_generic(uint8_t* ptr, const sensor_t* m)
+{
+    set_bits_le64(ptr, (uint64_t) m->type & 0x7ULL, 0, 3);
+    set_bits_le64(ptr, (uint64_t) m->chan & 0x1fULL, 3, 5);
+    set_bits_le64(ptr, (uint64_t) m->temp & 0xfffULL, 8, 12);
+    { int e; for (e = 0; e < 3; e++) set_bits_le64(ptr, (uint64_t) m->accel[e] & 0x3fffULL, 20 + e*14, 14); }
+    set_bits_le64(ptr, (uint64_t) m->stamp & 0xffffffffffULL, 62, 40);
+    set_bits_le64(ptr, (uint64_t) m->flags & 0xfULL, 120, 4);
+    set_bits_le64(ptr, (uint64_t) m->wide & 0xffffffffffffffffULL, 124, 64);
+    set_bits_le64(ptr, (uint64_t) m->tail & 0x1fULL, 188, 5);
+}
+
+static void sensor_unpack_generic(const uint8_t* ptr, sensor_t* m)
+{
+    uint64_t v;
+    get_bits_le64(ptr, &v, 0, 3); m->type = (uint8_t) v;
+    get_bits_le64(ptr, &v, 3, 5); m->chan = (uint8_t) v;
+    get_bits_le64(ptr, &v, 8, 12); m->temp = (int16_t) (((int64_t) (v << 52)) >> 52);
+    { int e; for (e = 0; e < 3; e++) { get_bits_le64(ptr, &v, 20 + e*14, 14); m->accel[e] = (int16_t) (((int64_t) (v << 50)) >> 50); } }
+    get_bits_le64(ptr, &v, 62, 40); m->stamp = (uint64_t) v;
+    get_bits_le64(ptr, &v, 120, 4); m->flags = (uint8_t) v;
+    get_bits_le64(ptr, &v, 124, 64); m->wide = (uint64_t) v;
+    get_bits_le64(ptr, &v, 188, 5); m->tail = (int8_t) (((int64_t) (v << 59)) >> 59);
+}
+
+static void mixed_pack_generic(uint8_t* ptr, const mixed_t* m)
+{
+    set_bits_be64(ptr, (uint64_t) m->a & 0x7fULL, 3, 7);
+    set_bits_be64(ptr, (uint64_t) m->b & 0x3fffffffULL, 10, 30);
+    set_bits_be64(ptr, (uint64_t) m->c & 0x1ffffffffULL, 60, 33);
+    set_bits_be64(ptr, (uint64_t) m->d & 0x1ULL, 93, 1);
+    { int e; for (e = 0; e < 4; e++) set_bits_be64(ptr, (uint64_t) m->e[e] & 0x1ffffULL, 94 + e*17, 17); }
+}
+
+static void mixed_unpack_generic(const uint8_t* ptr, mixed_t* m)
+{
+    uint64_t v;
+    get_bits_be64(ptr, &v, 3, 7); m->a = (uint8_t) v;
+    get_bits_be64(ptr, &v, 10, 30); m->b = (int32_t) (((int64_t) (v << 34)) >> 34);
+    get_bits_be64(ptr, &v, 60, 33); m->c = (uint64_t) v;
+    get_bits_be64(ptr, &v, 93, 1); m->d = (uint8_t) v;
+    { int e; for (e = 0; e < 4; e++) { get_bits_be64(ptr, &v, 94 + e*17, 17); m->e[e] = (int32_t) (((int64_t) (v << 47)) >> 47); } }
+}
+
+static void can_std_random(can_std_t* m)
+{
+    m->sof = (uint8_t) (rnd64() & 0x1ULL);
+    m->id = (uint16_t) (rnd64() & 0x7ffULL);
+    m->rtr = (uint8_t) (rnd64() & 0x1ULL);
+    m->ide = (uint8_t) (rnd64() & 0x1ULL);
+    m->r0 = (uint8_t) (rnd64() & 0x1ULL);
+    m->dlc = (uint8_t) (rnd64() & 0xfULL);
+    { int e; for (e = 0; e < 8; e++) m->data[e] = (uint8_t) (rnd64() & 0xffULL); }
+    m->crc = (uint16_t) (rnd64() & 0x7fffULL);
+}
+
+static int can_std_equal(const can_std_t* a, const can_std_t* b)
+{
+    if (a->sof != b->sof) return 0;
+    if (a->id != b->id) return 0;
+    if (a->rtr != b->rtr) return 0;
+    if (a->ide != b->ide) return 0;
+    if (a->r0 != b->r0) return 0;
+    if (a->dlc != b->dlc) return 0;
+    { int e; for (e = 0; e < 8; e++) if (a->data[e] != b->data[e]) return 0; }
+    if (a->crc != b->crc) return 0;
+    return 1;
+}
+
+static void sensor_random(sensor_t* m)
+{
+    m->type = (uint8_t) (rnd64() & 0x7ULL);
+    m->chan = (uint8_t) (rnd64() & 0x1fULL);
+    m->temp = (int16_t) (((int64_t) (rnd64() << 52)) >> 52);
+    { int e; for (e = 0; e < 3; e++) m->accel[e] = (int16_t) (((int64_t) (rnd64() << 50)) >> 50); }
+    m->stamp = (uint64_t) (rnd64() & 0xffffffffffULL);
+    m->flags = (uint8_t) (rnd64() & 0xfULL);
+    m->wide = (uint64_t) (rnd64() & 0xffffffffffffffffULL);
+    m->tail = (int8_t) (((int64_t) (rnd64() << 59)) >> 59);
+}
+
+static int sensor_equal(const sensor_t* a, const sensor_t* b)
+{
+    if (a->type != b->type) return 0;
+    if (a->chan != b->chan) return 0;
+    if (a->temp != b->temp) return 0;
+    { int e; for (e = 0; e < 3; e++) if (a->accel[e] != b->accel[e]) return 0; }
+    if (a->stamp != b->stamp) return 0;
+    if (a->flags != b->flags) return 0;
+    if (a->wide != b->wide) return 0;
+    if (a->tail != b->tail) return 0;
+    return 1;
+}
+
+static void mixed_random(mixed_t* m)
+{
+    m->a = (uint8_t) (rnd64() & 0x7fULL);
+    m->b = (int32_t) (((int64_t) (rnd64() << 34)) >> 34);
+    m->c = (uint64_t) (rnd64() & 0x1ffffffffULL);
+    m->d = (uint8_t) (rnd64() & 0x1ULL);
+    { int e; for (e = 0; e < 4; e++) m->e[e] = (int32_t) (((int64_t) (rnd64() << 47)) >> 47); }
+}
+
+static int mixed_equal(const mixed_t* a, const mixed_t* b)
+{
+    if (a->a != b->a) return 0;
+    if (a->b != b->b) return 0;
+    if (a->c != b->c) return 0;
+    if (a->d != b->d) return 0;
+    { int e; for (e = 0; e < 4; e++) if (a->e[e] != b->e[e]) return 0; }
+    return 1;
+}
+
+static void bitgen_round_trip(int n)
+{
+    int j;
+
+    for (j = 0; j < n; j++) {
+	uint8_t a[can_std_SIZE], b[can_std_SIZE];
+	can_std_t m, m1, m2;
+	int k;
+	for (k = 0; k < can_std_SIZE; k++)
+	    a[k] = b[k] = random();
+	can_std_random(&m);
+	can_std_pack(a, &m);
+	can_std_pack_generic(b, &m);
+	can_std_unpack(a, &m1);
+	can_std_unpack_generic(b, &m2);
+	if (memcmp(a, b, sizeof(a)) || !can_std_equal(&m, &m1) ||
+	    !can_std_equal(&m, &m2)) {
+	    fprintf(stderr, "FAIL: can_std\n");
+	    exit(1);
+	}
+    }
+    for (j = 0; j < n; j++) {
+	uint8_t a[sensor_SIZE], b[sensor_SIZE];
+	sensor_t m, m1, m2;
+	int k;
+	for (k = 0; k < sensor_SIZE; k++)
+	    a[k] = b[k] = random();
+	sensor_random(&m);
+	sensor_pack(a, &m);
+	sensor_pack_generic(b, &m);
+	sensor_unpack(a, &m1);
+	sensor_unpack_generic(b, &m2);
+	if (memcmp(a, b, sizeof(a)) || !sensor_equal(&m, &m1) ||
+	    !sensor_equal(&m, &m2)) {
+	    fprintf(stderr, "FAIL: sensor\n");
+	    exit(1);
+	}
+    }
+    for (j = 0; j < n; j++) {
+	uint8_t a[mixed_SIZE], b[mixed_SIZE];
+	mixed_t m, m1, m2;
+	int k;
+	for (k = 0; k < mixed_SIZE; k++)
+	    a[k] = b[k] = random();
+	mixed_random(&m);
+	mixed_pack(a, &m);
+	mixed_pack_generic(b, &m);
+	mixed_unpack(a, &m1);
+	mixed_unpack_generic(b, &m2);
+	if (memcmp(a, b, sizeof(a)) || !mixed_equal(&m, &m1) ||
+	    !mixed_equal(&m, &m2)) {
+	    fprintf(stderr, "FAIL: mixed\n");
+	    exit(1);
+	}
+    }
+}
+
+#ifndef BITGEN_NO_MAIN
+int main()
+{
+    bitgen_round_trip(10000);
+    exit(0);
+}
+#endif
@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef DEBUG
 // allow gdb debugging
@@ -63,6 +64,254 @@ static int inline get_bit_be(const uint8_t* ptr, int i)
  #define BYTE_OFFSET(ofs) ((uint32_t) (ofs) >> 3)
  #define BIT_OFFSET(ofs)  ((ofs) & 7)
 
+//
+// load/store 16 and 32 bit values from unaligned byte pointers, a
+// single memcpy when the byte order is the host order, else bswap
+//
+static uint16_t inline load_le16(const uint8_t* ptr)
+{
+    uint16_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap16(w);
+#endif
+    return w;
+}
+
+static void inline store_le16(uint8_t* ptr, uint16_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap16(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+static uint16_t inline load_be16(const uint8_t* ptr)
+{
+    uint16_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap16(w);
+#endif
+    return w;
+}
+
+static void inline store_be16(uint8_t* ptr, uint16_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap16(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+static uint32_t inline load_le32(const uint8_t* ptr)
+{
+    uint32_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap32(w);
+#endif
+    return w;
+}
+
+static void inline store_le32(uint8_t* ptr, uint32_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap32(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+static uint32_t inline load_be32(const uint8_t* ptr)
+{
+    uint32_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap32(w);
+#endif
+    return w;
+}
+
+static void inline store_be32(uint8_t* ptr, uint32_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap32(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+// compare ops, field op constant (bitpack_view.h, bitpack_scan.h)
+#define BITPACK_EQ 0
+#define BITPACK_NE 1
+#define BITPACK_LT 2
+#define BITPACK_LE 3
+#define BITPACK_GT 4
+#define BITPACK_GE 5
+
+//
+// Access pattern statistics, compile with -DBITPACK_STATS
+//
+// Counts calls, bits and the branch taken in set/seq/get/copy_bits
+// per fill order, and a histogram over (bit offset mod 8, width).
+// Counters are thread local (no atomics), a set/seq/get call of up to
+// 32 bits is a single increment, bitpack_stats() fold those counters
+// and return the calling thread's totals. Use bitpack_stats_merge to collect
+// counters from several threads. Without BITPACK_STATS the
+// BITPACK_STAT macros expand to nothing.
+//
+#define BITPACK_OP_SET    0
+#define BITPACK_OP_SEQ    1
+#define BITPACK_OP_GET    2
+#define BITPACK_OP_COPY   3
+#define BITPACK_NUM_OPS   4
+
+#define BITPACK_PATH_BYTE     0  // all bits in the same byte
+#define BITPACK_PATH_ALIGNED  1  // byte aligned, whole bytes moved
+#define BITPACK_PATH_SHIFTED  2  // bits must be shifted into place
+#define BITPACK_NUM_PATHS     3
+
+#define BITPACK_MAX_WIDTH  33    // widths above 32 share the last bucket
+
+// branch taken by set/get_bits for bit offset i (mod 8) and n bits
+#define BITPACK_BITS_PATH(i,n)						\
+    (((i)+(n)) < 8 ? BITPACK_PATH_BYTE :				\
+     (!(i) && !((n) & 7)) ? BITPACK_PATH_ALIGNED : BITPACK_PATH_SHIFTED)
+
+// branch taken by copy_bits for bit offsets soffs, doffs (mod 8)
+#define BITPACK_COPY_PATH(soffs,doffs,n)				\
+    ((!(soffs) && !(doffs) && !((n) & 7)) ? BITPACK_PATH_ALIGNED :	\
+     ((doffs)+(n)) < 8 ? BITPACK_PATH_BYTE :				\
+     ((soffs) == (doffs)) ? BITPACK_PATH_ALIGNED : BITPACK_PATH_SHIFTED)
+
+#ifdef BITPACK_STATS
+#include <stdio.h>
+
+typedef struct {
+    uint64_t calls[BITPACK_NUM_OPS][2][BITPACK_NUM_PATHS];
+    uint64_t bits[BITPACK_NUM_OPS][2];
+    uint64_t hist[BITPACK_NUM_OPS][2][8][BITPACK_MAX_WIDTH+1];
+} bitpack_stats_t;
+
+// weak so all translation units share one instance per thread,
+// bitpack_stats_sum_ is the folded copy returned by bitpack_stats()
+__attribute__((weak)) __thread bitpack_stats_t bitpack_stats_;
+__attribute__((weak)) __thread bitpack_stats_t bitpack_stats_sum_;
+// set/seq/get fields below 33 bits, indexed [op][be][width][offs]
+__attribute__((weak)) __thread uint64_t
+bitpack_stats_hist_[BITPACK_NUM_OPS][2][BITPACK_MAX_WIDTH][8];
+
+#define BITPACK_STAT_ALL_(op,be,path,offs,n) do {			\
+	bitpack_stats_t* s_ = &bitpack_stats_;				\
+	size_t w_ = ((n) > BITPACK_MAX_WIDTH) ? BITPACK_MAX_WIDTH : (n); \
+	s_->calls[op][be][path]++;					\
+	s_->bits[op][be] += (n);					\
+	s_->hist[op][be][BIT_OFFSET(offs)][w_]++;			\
+    } while(0)
+
+// fields up to 32 bits only bump one counter, calls, bits and the
+// histogram are derived from it in bitpack_stats()
+#define BITPACK_STAT(op,be,path,offs,n) do {				\
+	if ((n) < BITPACK_MAX_WIDTH)					\
+	    bitpack_stats_hist_[op][be][n][BIT_OFFSET(offs)]++;	\
+	else								\
+	    BITPACK_STAT_ALL_(op,be,path,offs,n);			\
+    } while(0)
+
+// copy path depends on both offsets, count everything
+#define BITPACK_STAT_COPY(be,path,offs,n)				\
+    BITPACK_STAT_ALL_(BITPACK_OP_COPY,be,path,offs,n)
+
+// fold the narrow counters into a copy of the stats and return it
+static inline bitpack_stats_t* bitpack_stats(void)
+{
+    bitpack_stats_t* s = &bitpack_stats_sum_;
+    int op, be, o, w;
+
+    memcpy(s, &bitpack_stats_, sizeof(bitpack_stats_t));
+    for (op = 0; op < BITPACK_NUM_OPS; op++) {
+	for (be = 0; be < 2; be++) {
+	    for (w = 0; w < BITPACK_MAX_WIDTH; w++) {
+		for (o = 0; o < 8; o++) {
+		    uint64_t h = bitpack_stats_hist_[op][be][w][o];
+		    s->calls[op][be][BITPACK_BITS_PATH(o, w)] += h;
+		    s->bits[op][be] += h*w;
+		    s->hist[op][be][o][w] += h;
+		}
+	    }
+	}
+    }
+    return s;
+}
+
+static void inline bitpack_stats_reset(void)
+{
+    memset(&bitpack_stats_, 0, sizeof(bitpack_stats_t));
+    memset(bitpack_stats_hist_, 0, sizeof(bitpack_stats_hist_));
+}
+
+static void inline bitpack_stats_merge(bitpack_stats_t* dst,
+				       const bitpack_stats_t* src)
+{
+    const uint64_t* s = (const uint64_t*) src;
+    uint64_t* d = (uint64_t*) dst;
+    size_t k;
+    for (k = 0; k < sizeof(bitpack_stats_t)/sizeof(uint64_t); k++)
+	d[k] += s[k];
+}
+
+// print call counts per branch and the histogram, most used first
+static void inline bitpack_stats_dump(FILE* f, const bitpack_stats_t* s)
+{
+    static const char* ops[] = { "set", "seq", "get", "copy" };
+    static const char* end[] = { "le", "be" };
+    int op, be, o, w;
+
+    for (op = 0; op < BITPACK_NUM_OPS; op++) {
+	for (be = 0; be < 2; be++) {
+	    const uint64_t* c = s->calls[op][be];
+	    uint64_t total = c[0] + c[1] + c[2];
+	    uint64_t last = ~(uint64_t) 0;
+	    if (total == 0)
+		continue;
+	    fprintf(f, "%s_bits_%s: calls=%llu bits=%llu "
+		    "byte=%llu aligned=%llu shifted=%llu\n",
+		    ops[op], end[be], (unsigned long long) total,
+		    (unsigned long long) s->bits[op][be],
+		    (unsigned long long) c[BITPACK_PATH_BYTE],
+		    (unsigned long long) c[BITPACK_PATH_ALIGNED],
+		    (unsigned long long) c[BITPACK_PATH_SHIFTED]);
+	    // selection by decreasing count, the table is small
+	    for (;;) {
+		uint64_t max = 0;
+		for (o = 0; o < 8; o++) {
+		    for (w = 0; w <= BITPACK_MAX_WIDTH; w++) {
+			uint64_t h = s->hist[op][be][o][w];
+			if ((h < last) && (h > max))
+			    max = h;
+		    }
+		}
+		if (max == 0)
+		    break;
+		for (o = 0; o < 8; o++) {
+		    for (w = 0; w <= BITPACK_MAX_WIDTH; w++) {
+			if (s->hist[op][be][o][w] == max)
+			    fprintf(f, "  offs=%d width=%s%d: %llu (%.1f%%)\n",
+				    o, (w == BITPACK_MAX_WIDTH) ? ">" : "",
+				    (w == BITPACK_MAX_WIDTH) ? 32 : w,
+				    (unsigned long long) max,
+				    100.0 * max / total);
+		    }
+		}
+		last = max;
+	    }
+	}
+    }
+}
+#else
+#define BITPACK_STAT(op,be,path,offs,n) do {} while(0)
+#define BITPACK_STAT_COPY(be,path,offs,n) do {} while(0)
+#endif
+
  //
  // write n bits into byte array pointed to by ptr,
  // from bit position i to bit position i+n  (n <= 32) from bits
@@ -89,6 +338,12 @@ static int inline set_bits_le(uint8_t* ptr, uint32_t value, int i, size_t n)
 
     i = BIT_OFFSET(i);
     j = BIT_OFFSET(j);
+    BITPACK_STAT(BITPACK_OP_SET, 0, BITPACK_BITS_PATH(i, n), i, n);
+    if (!i && ((n == 16) || (n == 32))) {  // byte aligned 16/32 bit field
+	if (n == 32) store_le32(ptr+k, value);
+	else store_le16(ptr+k, value);
+	return r;
+    }
 
     if ((i+n) < 8) {  // all bit in the same byte
 	uint8_t mask = L_MASK(i) & R_MASK(j);
@@ -111,7 +366,8 @@ static int inline set_bits_le(uint8_t* ptr, uint32_t value, int i, size_t n)
 	case 3: ptr[k+2] = (value >> 16);
 	case 2: ptr[k+1] = (value >> 8);
 	case 1: ptr[k] = value;
-	    k += nk; nk = (nk << 3); n -= nk; value >>= nk;
+	    k += nk; nk = (nk << 3); n -= nk;
+	    value = (nk < 32) ? (value >> nk) : 0;  // nk=32 is all bits
 	    break;
 	case 0:
 	    break;
@@ -132,7 +388,7 @@ static void inline set_bit_le(uint8_t* ptr, int val, int i)
     uint8_t src;
     i = BIT_OFFSET(i);
     src = val<<i;
-    ptr[k] = MASK_BITS(src, ptr[k], L_MASK(i));
+    ptr[k] = MASK_BITS(src, ptr[k], 1 << i);
 }
 
  #undef L_MASK
@@ -158,6 +414,7 @@ static void inline set_bit_le(uint8_t* ptr, int val, int i)
 
      i = BIT_OFFSET(i);
      j = BIT_OFFSET(j);
+     BITPACK_STAT(BITPACK_OP_SEQ, 0, BITPACK_BITS_PATH(i, n), i, n);
 
      if ((i+n) < 8) {  // all bit in the same byte
 	 uint8_t mask = L_MASK(i);
@@ -180,7 +437,8 @@ static void inline set_bit_le(uint8_t* ptr, int val, int i)
 	 case 3: ptr[k+2] = (value >> 16);
 	 case 2: ptr[k+1] = (value >> 8);
 	 case 1: ptr[k] = value;
-	     k += nk; nk = (nk << 3); n -= nk; value >>= nk;
+	     k += nk; nk = (nk << 3); n -= nk;
+	     value = (nk < 32) ? (value >> nk) : 0;  // nk=32 is all bits
 	     break;
 	 case 0:
 	     break;
@@ -227,6 +485,8 @@ static int inline copy_bits_le(
      dst   += BYTE_OFFSET(doffs);
      soffs = BIT_OFFSET(soffs);
      doffs = BIT_OFFSET(doffs);
+     BITPACK_STAT_COPY(0,
+		  BITPACK_COPY_PATH(soffs, doffs, n), doffs, n);
 
      // Byte copy loop
      if (!soffs && !doffs && !(n & 0x7)) {
@@ -343,6 +603,11 @@ static int inline get_bits_le(const uint8_t* ptr, uint32_t* value, int i, size_t
 
     i = BIT_OFFSET(i);
     j = BIT_OFFSET(j);
+    BITPACK_STAT(BITPACK_OP_GET, 0, BITPACK_BITS_PATH(i, n), i, n);
+    if (!i && ((n == 16) || (n == 32))) {  // byte aligned 16/32 bit field
+	*value = (n == 32) ? load_le32(ptr+k) : load_le16(ptr+k);
+	return r;
+    }
 
     if ((i+n) < 8) {  // all bit in the same byte
 	uint8_t mask = L_MASK(i) & R_MASK(j);
@@ -373,7 +638,7 @@ static int inline get_bits_le(const uint8_t* ptr, uint32_t* value, int i, size_t
 	 }
 	 if (n) {
 	     uint8_t mask = R_MASK(j);
-	     v |= ((ptr[k] & mask) << s);
+	     v |= ((uint32_t) (ptr[k] & mask) << s);
 	 }
 	 *value = v;
     }
@@ -382,7 +647,7 @@ static int inline get_bits_le(const uint8_t* ptr, uint32_t* value, int i, size_t
 
 static int inline get_bit_le2(const uint8_t* ptr, int k, int i)
 {
-    return (ptr[k] & L_MASK(i)) != 0;
+    return (ptr[k] >> i) & 1;
 }
 
  
@@ -433,6 +698,12 @@ static int inline set_bits_be(uint8_t* ptr, uint32_t value, int i, size_t n)
 
     i = BIT_OFFSET(i);
     j = BIT_OFFSET(j);
+    BITPACK_STAT(BITPACK_OP_SET, 1, BITPACK_BITS_PATH(i, n), i, n);
+    if (!i && ((n == 16) || (n == 32))) {  // byte aligned 16/32 bit field
+	if (n == 32) store_be32(ptr+k, value);
+	else store_be16(ptr+k, value);
+	return r;
+    }
 
     if ((i+n) < 8) {  // all bit in the same byte
 	uint8_t mask = L_MASK(i) & R_MASK(j);
@@ -473,8 +744,8 @@ static void inline set_bit_be(uint8_t* ptr, int val, int i)
     int k = i >> 3;     // byte position
     uint8_t src;
     i = BIT_OFFSET(i);
-    src = val << (8-i);
-    ptr[k] = MASK_BITS(src, ptr[k], L_MASK(i));
+    src = val << (7-i);
+    ptr[k] = MASK_BITS(src, ptr[k], 0x80 >> i);
 }
 
 #undef L_MASK
@@ -496,6 +767,7 @@ static int inline seq_bits_be(uint8_t* ptr, uint32_t value, int i, size_t n)
 
     i = BIT_OFFSET(i);
     j = BIT_OFFSET(j);
+    BITPACK_STAT(BITPACK_OP_SEQ, 1, BITPACK_BITS_PATH(i, n), i, n);
 
     if ((i+n) < 8) {  // all bit in the same byte
 	uint8_t mask = L_MASK(i);
@@ -563,6 +835,8 @@ static int inline copy_bits_be(
     dst   += BYTE_OFFSET(doffs);
     soffs = BIT_OFFSET(soffs);
     doffs = BIT_OFFSET(doffs);
+    BITPACK_STAT_COPY(1,
+		 BITPACK_COPY_PATH(soffs, doffs, n), doffs, n);
 
     // Byte copy loop
     if (!soffs && !doffs && !(n & 0x7)) {
@@ -677,6 +951,11 @@ static int inline get_bits_be(const uint8_t* ptr, uint32_t* value, int i, size_t
 
     i = BIT_OFFSET(i);
     j = BIT_OFFSET(j);
+    BITPACK_STAT(BITPACK_OP_GET, 1, BITPACK_BITS_PATH(i, n), i, n);
+    if (!i && ((n == 16) || (n == 32))) {  // byte aligned 16/32 bit field
+	*value = (n == 32) ? load_be32(ptr+k) : load_be16(ptr+k);
+	return r;
+    }
 
     if ((i+n) < 8) {  // all bit in the same byte
 	uint8_t mask = L_MASK(i) & R_MASK(j);
@@ -690,7 +969,7 @@ static int inline get_bits_be(const uint8_t* ptr, uint32_t* value, int i, size_t
 	if (n && i) {
 	    uint8_t  mask = L_MASK(i);
 	    s = (n < (8-i)) ? 0 : (8-i);
-	    v = ((ptr[k] & mask)) << (n-s);
+	    v = ((uint32_t) (ptr[k] & mask)) << (n-s);
 	    k++;
 	    n -= s;
 	}
@@ -716,7 +995,7 @@ static int inline get_bits_be(const uint8_t* ptr, uint32_t* value, int i, size_t
 
 static int inline get_bit_be2(const uint8_t* ptr, int k, int i)
 {
-    return (ptr[k] & L_MASK(i)) != 0;
+    return (ptr[k] >> (7-i)) & 1;
 }
 
 static int inline get_bit_be(const uint8_t* ptr, int i)
@@ -743,9 +1022,9 @@ static int inline clq_bits_be(uint8_t* ptr, int i, size_t n)
 static int inline set_bytes_le(uint8_t* ptr, uint32_t value, int i, size_t n)
 {
     switch(n) {
-    case 4: ptr[i+3] = (value>>24);
+    case 4: store_le32(ptr+i, value); break;
     case 3: ptr[i+2] = (value>>16);
-    case 2: ptr[i+1] = (value>>8);
+    case 2: store_le16(ptr+i, value); break;
     case 1: ptr[i]   = value; break;
     case 0: break;
     default: return -1;
@@ -754,17 +1033,48 @@ static int inline set_bytes_le(uint8_t* ptr, uint32_t value, int i, size_t n)
 }
 
 // pack n bytes big endian from i .. i+n-1  n=0,1,2,3,4
+// unlike set_bytes_le this returns the last byte written (i if n=0)
 static int inline set_bytes_be(uint8_t* ptr, uint32_t value, int i, size_t n)
 {
     switch(n) {
-    case 4: ptr[i++] = (value>>24);
-    case 3: ptr[i++] = (value>>16);
-    case 2: ptr[i++] = (value>>8);
+    case 4: store_be32(ptr+i, value); break;
+    case 3: ptr[i] = (value>>16); store_be16(ptr+i+1, value); break;
+    case 2: store_be16(ptr+i, value); break;
     case 1: ptr[i] = value; break;
     case 0: break;
     default: return -1;
     }
-    return i;
+    return n ? i+n-1 : i;
+}
+
+// unpack n bytes little endian from i .. i+n-1  n=0,1,2,3,4
+static int inline get_bytes_le(const uint8_t* ptr, uint32_t* value, int i,
+			       size_t n)
+{
+    switch(n) {
+    case 4: *value = load_le32(ptr+i); break;
+    case 3: *value = load_le16(ptr+i) | (ptr[i+2] << 16); break;
+    case 2: *value = load_le16(ptr+i); break;
+    case 1: *value = ptr[i]; break;
+    case 0: *value = 0; break;
+    default: return -1;
+    }
+    return i+n;
+}
+
+// unpack n bytes big endian from i .. i+n-1  n=0,1,2,3,4
+static int inline get_bytes_be(const uint8_t* ptr, uint32_t* value, int i,
+			       size_t n)
+{
+    switch(n) {
+    case 4: *value = load_be32(ptr+i); break;
+    case 3: *value = (ptr[i] << 16) | load_be16(ptr+i+1); break;
+    case 2: *value = load_be16(ptr+i); break;
+    case 1: *value = ptr[i]; break;
+    case 0: *value = 0; break;
+    default: return -1;
+    }
+    return i+n;
 }
 
 static void inline reverse_bytes(uint8_t* ptr, size_t n)
@@ -777,4 +1087,1344 @@ static void inline reverse_bytes(uint8_t* ptr, size_t n)
     }
 }
 
+#define MAKE_MASK64(n) ((((uint64_t) 1) << (n))-1)
+
+//
+// load/store 64 bit words from unaligned byte pointers
+// in little endian or big endian byte order
+//
+static uint64_t inline load_le64(const uint8_t* ptr)
+{
+    uint64_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+static void inline store_le64(uint8_t* ptr, uint64_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+static uint64_t inline load_be64(const uint8_t* ptr)
+{
+    uint64_t w;
+    memcpy(&w, ptr, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+static void inline store_be64(uint8_t* ptr, uint64_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(ptr, &w, sizeof(w));
+}
+
+//
+// convert n values of size bytes (1, 2, 4 or 8) between a byte array in
+// little or big endian order and an array of host integers. With the
+// host byte order this is one memcpy, otherwise the bytes of each value
+// are reversed with pshufb (SSSE3) 16 bytes at a time, or bswap.
+//
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+static int inline bytes_copy_array_(uint8_t* dst, const uint8_t* src,
+				    size_t n, size_t size, int swap)
+{
+    size_t i = 0;
+
+    if ((size != 1) && (size != 2) && (size != 4) && (size != 8))
+	return -1;
+    if (!swap || (size == 1)) {
+	memcpy(dst, src, n*size);
+	return 0;
+    }
+#ifdef __SSSE3__
+    {
+	__m128i m = (size == 2) ?
+	    _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14) :
+	    (size == 4) ?
+	    _mm_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12) :
+	    _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+	size_t nb = (n*size) & ~(size_t) 15;
+	for (; i < nb; i += 16) {
+	    __m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+	    _mm_storeu_si128((__m128i*) (dst + i), _mm_shuffle_epi8(x, m));
+	}
+    }
+#endif
+    for (; i < n*size; i += size) {
+	switch(size) {
+	case 2: {
+	    uint16_t w;
+	    memcpy(&w, src+i, 2);
+	    w = __builtin_bswap16(w);
+	    memcpy(dst+i, &w, 2);
+	    break;
+	}
+	case 4: {
+	    uint32_t w;
+	    memcpy(&w, src+i, 4);
+	    w = __builtin_bswap32(w);
+	    memcpy(dst+i, &w, 4);
+	    break;
+	}
+	default: {
+	    uint64_t w;
+	    memcpy(&w, src+i, 8);
+	    w = __builtin_bswap64(w);
+	    memcpy(dst+i, &w, 8);
+	    break;
+	}
+	}
+    }
+    return 0;
+}
+
+static int inline get_bytes_le_array(const uint8_t* ptr, void* values,
+				     size_t n, size_t size)
+{
+    return bytes_copy_array_((uint8_t*) values, ptr, n, size,
+			     __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+}
+
+static int inline get_bytes_be_array(const uint8_t* ptr, void* values,
+				     size_t n, size_t size)
+{
+    return bytes_copy_array_((uint8_t*) values, ptr, n, size,
+			     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+}
+
+static int inline set_bytes_le_array(uint8_t* ptr, const void* values,
+				     size_t n, size_t size)
+{
+    return bytes_copy_array_(ptr, (const uint8_t*) values, n, size,
+			     __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+}
+
+static int inline set_bytes_be_array(uint8_t* ptr, const void* values,
+				     size_t n, size_t size)
+{
+    return bytes_copy_array_(ptr, (const uint8_t*) values, n, size,
+			     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+}
+
+//
+// scatter count values of n bits (n <= 32) into the byte array ptr
+// of size bytes. values[k] is written at bit offset offs[k].
+// Updates that hit the same 64-bit word are combined into one
+// masked read-modify-write of that word.
+//
+// Updates to the same offset are applied in input order (last wins).
+// With SCATTER_SORT offsets are bucketed by cache line before writing,
+// partially overlapping fields at different offsets are then
+// written in unspecified order.
+// Return count, or -1 if n > 32 or an offset is out of range.
+//
+#define SCATTER_SORT   0x01   // bucket offsets by cache line
+#define SCATTER_LINE   9      // log2 of bits per cache line
+
+typedef struct {
+    size_t   w;     // word position (in 8 byte units)
+    uint64_t bits;  // accumulated bits
+    uint64_t mask;  // bits written so far
+} scatter_word_t;
+
+static void inline scatter_flush_(uint8_t* ptr, size_t size,
+				  scatter_word_t* sw, int be)
+{
+    size_t k = sw->w << 3;
+
+    if (!sw->mask)
+	return;
+    if (k+8 <= size) {
+	uint64_t w = be ? load_be64(ptr+k) : load_le64(ptr+k);
+	w = MASK_BITS(sw->bits, w, sw->mask);
+	if (be)
+	    store_be64(ptr+k, w);
+	else
+	    store_le64(ptr+k, w);
+    }
+    else {  // partial word at end of buffer
+	int b;
+	for (b = 0; (b < 8) && (k+b < size); b++) {
+	    int s = be ? (56-8*b) : 8*b;
+	    uint8_t mask = (uint8_t) (sw->mask >> s);
+	    ptr[k+b] = MASK_BITS((uint8_t)(sw->bits >> s), ptr[k+b], mask);
+	}
+    }
+    sw->mask = 0;
+    sw->bits = 0;
+}
+
+static void inline scatter_merge_(uint8_t* ptr, size_t size,
+				  scatter_word_t* sw, size_t w,
+				  uint64_t bits, uint64_t mask, int be)
+{
+    if (w != sw->w) {
+	scatter_flush_(ptr, size, sw, be);
+	sw->w = w;
+    }
+    sw->bits = MASK_BITS(bits, sw->bits, mask);
+    sw->mask |= mask;
+}
+
+static void inline scatter_range_(uint8_t* ptr, size_t size,
+				  const uint32_t* offs,
+				  const uint32_t* values,
+				  const uint32_t* order,
+				  size_t first, size_t last,
+				  size_t n, int be)
+{
+    scatter_word_t sw = { 0, 0, 0 };
+    uint64_t vmask = MAKE_MASK64(n);
+    size_t k;
+
+    for (k = first; k < last; k++) {
+	size_t   x = order ? order[k] : k;
+	uint32_t i = offs[x];
+	uint64_t v = values[x] & vmask;
+	size_t   w = i >> 6;     // word position
+	int      p = i & 63;     // bit position in word
+
+	if (!be) {
+	    scatter_merge_(ptr, size, &sw, w, v << p, vmask << p, be);
+	    if (p+n > 64)
+		scatter_merge_(ptr, size, &sw, w+1, v >> (64-p),
+			       MAKE_MASK64(p+n-64), be);
+	}
+	else if (p+n <= 64) {
+	    int s = 64-p-n;
+	    scatter_merge_(ptr, size, &sw, w, v << s, vmask << s, be);
+	}
+	else {
+	    int s = p+n-64;  // bits spilled into next word
+	    scatter_merge_(ptr, size, &sw, w, v >> s, MAKE_MASK64(n-s), be);
+	    scatter_merge_(ptr, size, &sw, w+1, v << (64-s),
+			   MAKE_MASK64(s) << (64-s), be);
+	}
+    }
+    scatter_flush_(ptr, size, &sw, be);
+}
+
+// check that all fields are within the buffer
+static int inline scatter_check_(const uint32_t* offs, size_t count,
+				 size_t size, size_t n)
+{
+    size_t k;
+    for (k = 0; k < count; k++) {
+	if ((uint64_t) offs[k] + n > ((uint64_t) size << 3))
+	    return 0;
+    }
+    return 1;
+}
+
+//
+// stable counting sort of offsets by cache line, order gets the
+// sorted value positions, start[l] the first position in line l
+// (start must have room for nlines+1 entries)
+//
+static void inline scatter_order_(const uint32_t* offs, size_t count,
+				  size_t nlines, uint32_t* order,
+				  size_t* start)
+{
+    size_t k;
+    memset(start, 0, (nlines+1)*sizeof(size_t));
+    for (k = 0; k < count; k++)
+	start[(offs[k] >> SCATTER_LINE)+1]++;
+    for (k = 0; k < nlines; k++)
+	start[k+1] += start[k];
+    for (k = 0; k < count; k++)
+	order[start[offs[k] >> SCATTER_LINE]++] = k;
+    // start[l] now hold the end of line l, shift back
+    for (k = nlines; k > 0; k--)
+	start[k] = start[k-1];
+    start[0] = 0;
+}
+
+static long inline scatter_bits_(uint8_t* ptr, size_t size,
+				 const uint32_t* offs, const uint32_t* values,
+				 size_t count, size_t n, int flags, int be)
+{
+    uint32_t* order = NULL;
+
+    if ((n > 32) || !scatter_check_(offs, count, size, n))
+	return -1;
+    if (n == 0)
+	return count;
+    if ((flags & SCATTER_SORT) && (count > 1)) {
+	size_t nlines = (size+63) >> 6;
+	size_t* start = (size_t*) malloc((nlines+1)*sizeof(size_t));
+	order = (uint32_t*) malloc(count*sizeof(uint32_t));
+	if (start && order)
+	    scatter_order_(offs, count, nlines, order, start);
+	else {  // unsorted scatter is still correct
+	    free(order);
+	    order = NULL;
+	}
+	free(start);
+    }
+    scatter_range_(ptr, size, offs, values, order, 0, count, n, be);
+    free(order);
+    return count;
+}
+
+static long inline scatter_bits_le(uint8_t* ptr, size_t size,
+				   const uint32_t* offs, const uint32_t* values,
+				   size_t count, size_t n, int flags)
+{
+    return scatter_bits_(ptr, size, offs, values, count, n, flags, 0);
+}
+
+static long inline scatter_bits_be(uint8_t* ptr, size_t size,
+				   const uint32_t* offs, const uint32_t* values,
+				   size_t count, size_t n, int flags)
+{
+    return scatter_bits_(ptr, size, offs, values, count, n, flags, 1);
+}
+
+#ifdef BITPACK_THREADS
+#include <pthread.h>
+
+//
+// scatter using up to nthreads threads. offsets are bucketed by
+// cache line and split on line boundaries not crossed by any field,
+// so each thread writes a disjoint range of words.
+//
+typedef struct {
+    uint8_t*        ptr;
+    size_t          size;
+    const uint32_t* offs;
+    const uint32_t* values;
+    const uint32_t* order;
+    size_t          first;
+    size_t          last;
+    size_t          n;
+    int             be;
+} scatter_job_t;
+
+static void* scatter_job_(void* arg)
+{
+    scatter_job_t* job = (scatter_job_t*) arg;
+    scatter_range_(job->ptr, job->size, job->offs, job->values, job->order,
+		   job->first, job->last, job->n, job->be);
+    return NULL;
+}
+
+// check if any field in cache line l continue into the next line
+static int inline scatter_straddle_(const uint32_t* offs,
+				    const uint32_t* order,
+				    const size_t* start, size_t l, size_t n)
+{
+    size_t k;
+    for (k = start[l]; k < start[l+1]; k++) {
+	if (((offs[order[k]]+n-1) >> SCATTER_LINE) != l)
+	    return 1;
+    }
+    return 0;
+}
+
+static long inline scatter_bits_mt_(uint8_t* ptr, size_t size,
+				    const uint32_t* offs,
+				    const uint32_t* values,
+				    size_t count, size_t n, int nthreads, int be)
+{
+    size_t nlines = (size+63) >> 6;
+    size_t per, first, l;
+    uint32_t* order;
+    size_t* start;
+    scatter_job_t* job;
+    pthread_t* tid;
+    int t, nt;
+
+    if ((nthreads <= 1) || (count < 2) || (n == 0))
+	return scatter_bits_(ptr, size, offs, values, count, n,
+			     SCATTER_SORT, be);
+    if ((n > 32) || !scatter_check_(offs, count, size, n))
+	return -1;
+    order = (uint32_t*) malloc(count*sizeof(uint32_t));
+    start = (size_t*) malloc((nlines+1)*sizeof(size_t));
+    job   = (scatter_job_t*) malloc(nthreads*sizeof(scatter_job_t));
+    tid   = (pthread_t*) malloc(nthreads*sizeof(pthread_t));
+    if (!order || !start || !job || !tid) {
+	free(order); free(start); free(job); free(tid);
+	return scatter_bits_(ptr, size, offs, values, count, n, 0, be);
+    }
+    scatter_order_(offs, count, nlines, order, start);
+
+    // split into nthreads parts of about the same number of updates
+    per = (count + nthreads - 1) / nthreads;
+    first = 0;
+    nt = 0;
+    for (l = 0; (l < nlines) && (nt < nthreads-1); l++) {
+	size_t last = start[l+1];
+	if ((last - first >= per) && (last < count) &&
+	    !scatter_straddle_(offs, order, start, l, n)) {
+	    job[nt].first = first;
+	    job[nt].last  = last;
+	    nt++;
+	    first = last;
+	}
+    }
+    job[nt].first = first;
+    job[nt].last  = count;
+    nt++;
+
+    for (t = 0; t < nt; t++) {
+	job[t].ptr = ptr;
+	job[t].size = size;
+	job[t].offs = offs;
+	job[t].values = values;
+	job[t].order = order;
+	job[t].n = n;
+	job[t].be = be;
+    }
+    // run the first part in the calling thread
+    for (t = 1; t < nt; t++) {
+	if (pthread_create(&tid[t], NULL, scatter_job_, &job[t]) != 0) {
+	    scatter_job_(&job[t]);
+	    job[t].ptr = NULL;  // mark as done
+	}
+    }
+    scatter_job_(&job[0]);
+    for (t = 1; t < nt; t++) {
+	if (job[t].ptr)
+	    pthread_join(tid[t], NULL);
+    }
+    free(order); free(start); free(job); free(tid);
+    return count;
+}
+
+static long inline scatter_bits_le_mt(uint8_t* ptr, size_t size,
+				      const uint32_t* offs,
+				      const uint32_t* values,
+				      size_t count, size_t n, int nthreads)
+{
+    return scatter_bits_mt_(ptr, size, offs, values, count, n, nthreads, 0);
+}
+
+static long inline scatter_bits_be_mt(uint8_t* ptr, size_t size,
+				      const uint32_t* offs,
+				      const uint32_t* values,
+				      size_t count, size_t n, int nthreads)
+{
+    return scatter_bits_mt_(ptr, size, offs, values, count, n, nthreads, 1);
+}
+
+//
+// Thread pool, nthreads workers wait for batches of tasks. The thread
+// calling bitpack_pool_run take tasks too and return when all tasks in
+// the batch are done. Only one thread may call bitpack_pool_run at a
+// time.
+//
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;      // new batch or stop
+    pthread_cond_t  done;      // batch done
+    pthread_t*      tid;
+    int             nthreads;
+    void          (*fn)(void* arg, int i);
+    void*           arg;
+    int             ntasks;
+    int             next;      // next task to run
+    int             ndone;
+    int             stop;
+} bitpack_pool_t;
+
+// take and run tasks until the batch is empty, called with the lock held
+static void inline bitpack_pool_work_(bitpack_pool_t* p)
+{
+    while (p->next < p->ntasks) {
+	int i = p->next++;
+	pthread_mutex_unlock(&p->lock);
+	p->fn(p->arg, i);
+	pthread_mutex_lock(&p->lock);
+	if (++p->ndone == p->ntasks)
+	    pthread_cond_signal(&p->done);
+    }
+}
+
+static void* bitpack_pool_main_(void* arg)
+{
+    bitpack_pool_t* p = (bitpack_pool_t*) arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+	if (p->next < p->ntasks)
+	    bitpack_pool_work_(p);
+	else
+	    pthread_cond_wait(&p->work, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static int inline bitpack_pool_init(bitpack_pool_t* p, int nthreads)
+{
+    int t;
+
+    memset(p, 0, sizeof(bitpack_pool_t));
+    if (nthreads < 0)
+	return -1;
+    if (nthreads && !(p->tid = (pthread_t*) malloc(nthreads*sizeof(pthread_t))))
+	return -1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    for (t = 0; t < nthreads; t++) {
+	if (pthread_create(&p->tid[t], NULL, bitpack_pool_main_, p) != 0)
+	    break;
+    }
+    p->nthreads = t;  // the threads that could be started
+    return 0;
+}
+
+static void inline bitpack_pool_destroy(bitpack_pool_t* p)
+{
+    int t;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (t = 0; t < p->nthreads; t++)
+	pthread_join(p->tid[t], NULL);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+    free(p->tid);
+    p->tid = NULL;
+    p->nthreads = 0;
+}
+
+// run fn(arg, i) for i = 0 .. ntasks-1 and wait for all to finish
+static void inline bitpack_pool_run(bitpack_pool_t* p,
+				    void (*fn)(void* arg, int i), void* arg,
+				    int ntasks)
+{
+    pthread_mutex_lock(&p->lock);
+    p->fn = fn;
+    p->arg = arg;
+    p->next = 0;
+    p->ndone = 0;
+    p->ntasks = ntasks;
+    pthread_cond_broadcast(&p->work);
+    bitpack_pool_work_(p);
+    while (p->ndone < p->ntasks)
+	pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+//
+// copy n bits from src:soffs to dst:doffs with the pool (src and dst
+// must not overlap). The range is split on destination byte boundaries
+// into chunks of whole bytes copied in parallel, the partial first and
+// last destination bytes are written with masks when the chunks are
+// done. Offsets are 64 bit, each chunk is below 2^31 bits.
+//
+#define COPY_MT_MIN   (1 << 16)   // min chunk size in bytes
+#define COPY_MT_MAX   (1 << 27)   // max chunk size in bytes
+
+typedef struct {
+    uint8_t* src;
+    size_t   soffs;     // source bit offset of the first whole byte
+    uint8_t* dst;       // first whole destination byte
+    size_t   nbytes;
+    size_t   chunk;     // bytes per task
+    int      be;
+} copy_job_t;
+
+static void copy_task_(void* arg, int i)
+{
+    copy_job_t* job = (copy_job_t*) arg;
+    size_t first = (size_t) i * job->chunk;
+    size_t len = job->nbytes - first;
+    size_t s = job->soffs + 8*first;
+
+    if (len > job->chunk)
+	len = job->chunk;
+    if (job->be)
+	copy_bits_be(job->src + (s >> 3), BIT_OFFSET(s), job->dst + first, 0,
+		     8*len);
+    else
+	copy_bits_le(job->src + (s >> 3), BIT_OFFSET(s), job->dst + first, 0,
+		     8*len);
+}
+
+static void inline copy_part_(uint8_t* src, size_t soffs,
+			      uint8_t* dst, size_t doffs, size_t n, int be)
+{
+    if (be)
+	copy_bits_be(src + (soffs >> 3), BIT_OFFSET(soffs),
+		     dst + (doffs >> 3), BIT_OFFSET(doffs), n);
+    else
+	copy_bits_le(src + (soffs >> 3), BIT_OFFSET(soffs),
+		     dst + (doffs >> 3), BIT_OFFSET(doffs), n);
+}
+
+static int inline copy_bits_mt_(bitpack_pool_t* pool,
+				uint8_t* src, size_t soffs,
+				uint8_t* dst, size_t doffs, size_t n, int be)
+{
+    size_t head = (8 - BIT_OFFSET(doffs)) & 7;  // bits to a byte boundary
+    size_t tail;
+    size_t ntasks;
+    copy_job_t job;
+    int i;
+
+    if (head > n)
+	head = n;
+    job.src = src;
+    job.soffs = soffs + head;
+    job.dst = dst + ((doffs + head) >> 3);
+    job.nbytes = (n - head) >> 3;
+    job.be = be;
+    tail = (n - head) & 7;
+
+    // about four chunks per thread
+    ntasks = pool ? 4*(pool->nthreads + 1) : 1;
+    job.chunk = (job.nbytes + ntasks - 1) / ntasks;
+    if (job.chunk < COPY_MT_MIN)
+	job.chunk = COPY_MT_MIN;
+    if (job.chunk > COPY_MT_MAX)
+	job.chunk = COPY_MT_MAX;
+    ntasks = (job.nbytes + job.chunk - 1) / job.chunk;
+    if (pool && (pool->nthreads > 0) && (ntasks > 1))
+	bitpack_pool_run(pool, copy_task_, &job, ntasks);
+    else {
+	for (i = 0; i < (int) ntasks; i++)
+	    copy_task_(&job, i);
+    }
+    // boundary bytes
+    if (head)
+	copy_part_(src, soffs, dst, doffs, head, be);
+    if (tail)
+	copy_part_(src, soffs + n - tail, dst, doffs + n - tail, tail, be);
+    return 0;
+}
+
+static int inline copy_bits_le_mt(bitpack_pool_t* pool,
+				  uint8_t* src, size_t soffs,
+				  uint8_t* dst, size_t doffs, size_t n)
+{
+    return copy_bits_mt_(pool, src, soffs, dst, doffs, n, 0);
+}
+
+static int inline copy_bits_be_mt(bitpack_pool_t* pool,
+				  uint8_t* src, size_t soffs,
+				  uint8_t* dst, size_t doffs, size_t n)
+{
+    return copy_bits_mt_(pool, src, soffs, dst, doffs, n, 1);
+}
+
+#endif
+
+//
+// bit matrix transpose
+//
+// An 8x8 matrix is 8 bytes, row r is byte r. A 64x64 matrix is 512
+// bytes, row r is the 8 bytes at 8*r. Column c is bit c of the row
+// in little or big endian fill order (as get_bit_le/get_bit_be).
+// Row c of the result holds column c of the source.
+//
+
+// delta swap transpose of 8x8 bits with bit (r,c) at 8*r+c
+static uint64_t inline transpose8_(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7))  & 0x00AA00AA00AA00AAULL;  x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;  x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;  x ^= t ^ (t << 28);
+    return x;
+}
+
+// the big endian index 63-(8*r+c) is symmetric under transpose as well
+static void inline transpose_8x8_le(const uint8_t* src, uint8_t* dst)
+{
+    store_le64(dst, transpose8_(load_le64(src)));
+}
+
+static void inline transpose_8x8_be(const uint8_t* src, uint8_t* dst)
+{
+    store_be64(dst, transpose8_(load_be64(src)));
+}
+
+// recursive block swap transpose of 64x64 bits, column c is bit c of a[r]
+static void inline transpose64_(uint64_t* a)
+{
+    uint64_t m = 0x00000000FFFFFFFFULL;
+    int j, k;
+
+    for (j = 32; j; j >>= 1, m ^= (m << j)) {
+	for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+	    uint64_t t = ((a[k] >> j) ^ a[k|j]) & m;
+	    a[k]   ^= (t << j);
+	    a[k|j] ^= t;
+	}
+    }
+}
+
+static void inline transpose64_scalar_(const uint8_t* src, uint8_t* dst,
+				       int be)
+{
+    uint64_t a[64];
+    int r;
+
+    // big endian rows are loaded reversed, so that column 0 is bit 0
+    for (r = 0; r < 64; r++) {
+	if (be)
+	    a[63-r] = load_be64(src + 8*r);
+	else
+	    a[r] = load_le64(src + 8*r);
+    }
+    transpose64_(a);
+    for (r = 0; r < 64; r++) {
+	if (be)
+	    store_be64(dst + 8*r, a[63-r]);
+	else
+	    store_le64(dst + 8*r, a[r]);
+    }
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+//
+// 16 rows at a time are transposed to byte columns with unpack, then
+// movemask pick one bit column from the 16 rows. Big endian rows are
+// loaded in reversed order within each byte so the masks can be
+// stored as is.
+//
+static void inline transpose64_sse2_(const uint8_t* src, uint8_t* dst,
+				     int be)
+{
+    int blk, b, i;
+
+    for (blk = 0; blk < 64; blk += 16) {
+	__m128i r[16], a[8], lo[4], hi[4], t[4], u[4], c[8];
+
+	for (i = 0; i < 16; i++) {
+	    int row = blk + (be ? (i ^ 7) : i);
+	    r[i] = _mm_loadl_epi64((const __m128i*) (src + 8*row));
+	}
+	for (i = 0; i < 8; i++)
+	    a[i] = _mm_unpacklo_epi8(r[2*i], r[2*i+1]);
+	for (i = 0; i < 4; i++) {
+	    lo[i] = _mm_unpacklo_epi16(a[2*i], a[2*i+1]);  // bytes 0..3
+	    hi[i] = _mm_unpackhi_epi16(a[2*i], a[2*i+1]);  // bytes 4..7
+	}
+	t[0] = _mm_unpacklo_epi32(lo[0], lo[1]);  // rows 0..7
+	t[1] = _mm_unpackhi_epi32(lo[0], lo[1]);
+	t[2] = _mm_unpacklo_epi32(hi[0], hi[1]);
+	t[3] = _mm_unpackhi_epi32(hi[0], hi[1]);
+	u[0] = _mm_unpacklo_epi32(lo[2], lo[3]);  // rows 8..15
+	u[1] = _mm_unpackhi_epi32(lo[2], lo[3]);
+	u[2] = _mm_unpacklo_epi32(hi[2], hi[3]);
+	u[3] = _mm_unpackhi_epi32(hi[2], hi[3]);
+	for (i = 0; i < 4; i++) {
+	    c[2*i]   = _mm_unpacklo_epi64(t[i], u[i]);
+	    c[2*i+1] = _mm_unpackhi_epi64(t[i], u[i]);
+	}
+	// c[b] is byte b of the 16 rows
+	for (b = 0; b < 8; b++) {
+	    __m128i x = c[b];
+	    for (i = 0; i < 8; i++) {
+		int m = _mm_movemask_epi8(x);
+		int row = be ? (8*b + i) : (8*b + 7 - i);
+		dst[8*row + (blk >> 3)]     = m;
+		dst[8*row + (blk >> 3) + 1] = m >> 8;
+		x = _mm_add_epi8(x, x);
+	    }
+	}
+    }
+}
+#endif
+
+// src and dst must not overlap
+static void inline transpose_64x64_le(const uint8_t* src, uint8_t* dst)
+{
+#ifdef __SSE2__
+    transpose64_sse2_(src, dst, 0);
+#else
+    transpose64_scalar_(src, dst, 0);
+#endif
+}
+
+static void inline transpose_64x64_be(const uint8_t* src, uint8_t* dst)
+{
+#ifdef __SSE2__
+    transpose64_sse2_(src, dst, 1);
+#else
+    transpose64_scalar_(src, dst, 1);
+#endif
+}
+
+//
+// convert n values of w bits (w <= 32), packed from bit 0 of src,
+// into w bit planes. Plane j holds the j:th bit (in fill order) of
+// every value, that is bit j of the value for little endian and bit
+// w-1-j for big endian. Plane j start at planes + j*BITPLANE_SIZE(n),
+// unused bits at the end of a plane are set to zero.
+// Return the number of bits converted (n*w), or -1 unless 1 <= w <= 32.
+//
+#define BITPLANE_SIZE(n) ((((size_t) (n) + 63) >> 6) << 3)
+
+// read value k of a packed column of n values of w bits
+static uint32_t inline get_packed_(const uint8_t* src, size_t n,
+				   size_t w, size_t k, int be)
+{
+    size_t o = k*w;
+    size_t b = o >> 3;
+    uint32_t v = 0;
+
+    if (b + 8 <= ((n*w + 7) >> 3)) {
+	uint64_t x = be ? (load_be64(src+b) >> (64 - (o & 7) - w))
+	    : (load_le64(src+b) >> (o & 7));
+	return x & MAKE_MASK64(w);
+    }
+    if (be)
+	get_bits_be(src, &v, o, w);
+    else
+	get_bits_le(src, &v, o, w);
+    return v;
+}
+
+static long inline bits_to_planes_(const uint8_t* src, size_t n, size_t w,
+				   uint8_t* planes, int be)
+{
+    size_t psize = BITPLANE_SIZE(n);
+    size_t k, j;
+
+    if ((w == 0) || (w > 32))
+	return -1;
+    if (w <= 8) {  // 8 values at a time with 8x8 transpose
+	size_t nb = (n + 7) >> 3;
+	for (k = 0; k < nb; k++) {
+	    uint64_t x = 0;
+	    int i;
+	    for (i = 0; (i < 8) && (8*k+i < n); i++) {
+		uint64_t v = get_packed_(src, n, w, 8*k+i, be);
+		x |= be ? ((v << (8-w)) << (56-8*i)) : (v << (8*i));
+	    }
+	    x = transpose8_(x);
+	    for (j = 0; j < w; j++)
+		planes[j*psize + k] = be ? (x >> (56-8*j)) : (x >> (8*j));
+	}
+	for (j = 0; j < w; j++)
+	    memset(planes + j*psize + nb, 0, psize - nb);
+    }
+    else {  // 64 values at a time with 64x64 transpose
+	uint8_t blk[512];
+	uint8_t tblk[512];
+	for (k = 0; k < n; k += 64) {
+	    int i;
+	    for (i = 0; i < 64; i++) {
+		uint64_t v = (k+i < n) ? get_packed_(src, n, w, k+i, be) : 0;
+		if (be)
+		    store_be64(blk + 8*i, v << (64-w));
+		else
+		    store_le64(blk + 8*i, v);
+	    }
+	    if (be)
+		transpose_64x64_be(blk, tblk);
+	    else
+		transpose_64x64_le(blk, tblk);
+	    for (j = 0; j < w; j++)
+		memcpy(planes + j*psize + (k >> 3), tblk + 8*j, 8);
+	}
+    }
+    return n*w;
+}
+
+static long inline planes_to_bits_(const uint8_t* planes, size_t n, size_t w,
+				   uint8_t* dst, int be)
+{
+    size_t psize = BITPLANE_SIZE(n);
+    size_t k, j;
+    uint8_t tail = 0;
+    int i, e;
+
+    if ((w == 0) || (w > 32))
+	return -1;
+    // values are written in sequence, bits after the last value
+    // in the last byte are restored at the end
+    e = BIT_OFFSET(n*w);
+    if (e)
+	tail = dst[(n*w) >> 3];
+#define PUT_VALUE(v, kk) do {						\
+	if (be) seq_bits_be(dst, (v), (kk)*w, w);			\
+	else seq_bits_le(dst, (v), (kk)*w, w);				\
+    } while(0)
+
+    if (w <= 8) {
+	size_t nb = (n + 7) >> 3;
+	for (k = 0; k < nb; k++) {
+	    uint64_t x = 0;
+	    for (j = 0; j < w; j++) {
+		uint64_t p = planes[j*psize + k];
+		x |= be ? (p << (56-8*j)) : (p << (8*j));
+	    }
+	    x = transpose8_(x);
+	    for (i = 0; (i < 8) && (8*k+i < n); i++) {
+		uint32_t v = be ? ((x >> (56-8*i)) & 0xff) >> (8-w)
+		    : (x >> (8*i)) & MAKE_MASK(w);
+		PUT_VALUE(v, 8*k+i);
+	    }
+	}
+    }
+    else {
+	uint8_t blk[512];
+	uint8_t tblk[512];
+	memset(blk, 0, sizeof(blk));
+	for (k = 0; k < n; k += 64) {
+	    for (j = 0; j < w; j++)
+		memcpy(blk + 8*j, planes + j*psize + (k >> 3), 8);
+	    if (be)
+		transpose_64x64_be(blk, tblk);
+	    else
+		transpose_64x64_le(blk, tblk);
+	    for (i = 0; (i < 64) && (k+i < n); i++) {
+		uint32_t v = be ? (load_be64(tblk + 8*i) >> (64-w))
+		    : (load_le64(tblk + 8*i) & MAKE_MASK64(w));
+		PUT_VALUE(v, k+i);
+	    }
+	}
+    }
+#undef PUT_VALUE
+    if (e) {
+	uint8_t mask = be ? ~MAKE_MASK(8-e) : MAKE_MASK(e);
+	dst[(n*w) >> 3] = MASK_BITS(dst[(n*w) >> 3], tail, mask);
+    }
+    return n*w;
+}
+
+static long inline bits_to_planes_le(const uint8_t* src, size_t n, size_t w,
+				     uint8_t* planes)
+{
+    return bits_to_planes_(src, n, w, planes, 0);
+}
+
+static long inline bits_to_planes_be(const uint8_t* src, size_t n, size_t w,
+				     uint8_t* planes)
+{
+    return bits_to_planes_(src, n, w, planes, 1);
+}
+
+static long inline planes_to_bits_le(const uint8_t* planes, size_t n,
+				     size_t w, uint8_t* dst)
+{
+    return planes_to_bits_(planes, n, w, dst, 0);
+}
+
+static long inline planes_to_bits_be(const uint8_t* planes, size_t n,
+				     size_t w, uint8_t* dst)
+{
+    return planes_to_bits_(planes, n, w, dst, 1);
+}
+
+//
+// 64 bit versions of set_bits/get_bits (n <= 64)
+// little endian store the low 32 bits first, big endian the high bits
+//
+static int inline set_bits_le64(uint8_t* ptr, uint64_t value, int i, size_t n)
+{
+    if (n <= 32)
+	return set_bits_le(ptr, (uint32_t) value, i, n);
+    if (n > 64)
+	return -1;
+    i = set_bits_le(ptr, (uint32_t) value, i, 32);
+    return set_bits_le(ptr, (uint32_t) (value >> 32), i, n-32);
+}
+
+static int inline get_bits_le64(const uint8_t* ptr, uint64_t* value,
+				int i, size_t n)
+{
+    uint32_t lo = 0, hi = 0;
+    if (n <= 32) {
+	i = get_bits_le(ptr, &lo, i, n);
+	*value = lo;
+	return i;
+    }
+    if (n > 64)
+	return -1;
+    i = get_bits_le(ptr, &lo, i, 32);
+    i = get_bits_le(ptr, &hi, i, n-32);
+    *value = ((uint64_t) hi << 32) | lo;
+    return i;
+}
+
+static int inline set_bits_be64(uint8_t* ptr, uint64_t value, int i, size_t n)
+{
+    if (n <= 32)
+	return set_bits_be(ptr, (uint32_t) value, i, n);
+    if (n > 64)
+	return -1;
+    i = set_bits_be(ptr, (uint32_t) (value >> 32), i, n-32);
+    return set_bits_be(ptr, (uint32_t) value, i, 32);
+}
+
+static int inline get_bits_be64(const uint8_t* ptr, uint64_t* value,
+				int i, size_t n)
+{
+    uint32_t lo = 0, hi = 0;
+    if (n <= 32) {
+	i = get_bits_be(ptr, &lo, i, n);
+	*value = lo;
+	return i;
+    }
+    if (n > 64)
+	return -1;
+    i = get_bits_be(ptr, &hi, i, n-32);
+    i = get_bits_be(ptr, &lo, i, 32);
+    *value = ((uint64_t) hi << 32) | lo;
+    return i;
+}
+
+//
+// Morton (Z-order) interleave of 2D and 3D coordinates.
+// Bit k of x goes to bit 2k (3k) of the key, y to 2k+1 (3k+1)
+// and z to 3k+2. Uses pdep/pext when compiled with BMI2, otherwise
+// magic number shift and mask.
+//
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#define MORTON2_X 0x5555555555555555ULL
+#define MORTON3_X 0x1249249249249249ULL
+
+// spread the low 32 bits of x to the even bits
+static uint64_t inline morton_spread2_(uint64_t x)
+{
+#ifdef __BMI2__
+    return _pdep_u64(x, MORTON2_X);
+#else
+    x &= 0x00000000FFFFFFFFULL;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2))  & 0x3333333333333333ULL;
+    x = (x | (x << 1))  & 0x5555555555555555ULL;
+    return x;
+#endif
+}
+
+// gather the even bits of x
+static uint64_t inline morton_compact2_(uint64_t x)
+{
+#ifdef __BMI2__
+    return _pext_u64(x, MORTON2_X);
+#else
+    x &= 0x5555555555555555ULL;
+    x = (x ^ (x >> 1))  & 0x3333333333333333ULL;
+    x = (x ^ (x >> 2))  & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x ^ (x >> 4))  & 0x00FF00FF00FF00FFULL;
+    x = (x ^ (x >> 8))  & 0x0000FFFF0000FFFFULL;
+    x = (x ^ (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return x;
+#endif
+}
+
+// spread the low 21 bits of x to every third bit
+static uint64_t inline morton_spread3_(uint64_t x)
+{
+#ifdef __BMI2__
+    return _pdep_u64(x, MORTON3_X);
+#else
+    x &= 0x00000000001FFFFFULL;
+    x = (x | (x << 32)) & 0x001F00000000FFFFULL;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFULL;
+    x = (x | (x << 8))  & 0x100F00F00F00F00FULL;
+    x = (x | (x << 4))  & 0x10C30C30C30C30C3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+    return x;
+#endif
+}
+
+// gather every third bit of x
+static uint64_t inline morton_compact3_(uint64_t x)
+{
+#ifdef __BMI2__
+    return _pext_u64(x, MORTON3_X);
+#else
+    x &= 0x1249249249249249ULL;
+    x = (x ^ (x >> 2))  & 0x10C30C30C30C30C3ULL;
+    x = (x ^ (x >> 4))  & 0x100F00F00F00F00FULL;
+    x = (x ^ (x >> 8))  & 0x001F0000FF0000FFULL;
+    x = (x ^ (x >> 16)) & 0x001F00000000FFFFULL;
+    x = (x ^ (x >> 32)) & 0x00000000001FFFFFULL;
+    return x;
+#endif
+}
+
+// 2 x 16 bits => 32 bits
+static uint32_t inline interleave_bits_2d16(uint16_t x, uint16_t y)
+{
+    return morton_spread2_(x) | (morton_spread2_(y) << 1);
+}
+
+static void inline deinterleave_bits_2d16(uint32_t key, uint16_t* x,
+					  uint16_t* y)
+{
+    *x = morton_compact2_(key);
+    *y = morton_compact2_(key >> 1);
+}
+
+// 2 x 32 bits => 64 bits
+static uint64_t inline interleave_bits_2d32(uint32_t x, uint32_t y)
+{
+    return morton_spread2_(x) | (morton_spread2_(y) << 1);
+}
+
+static void inline deinterleave_bits_2d32(uint64_t key, uint32_t* x,
+					  uint32_t* y)
+{
+    *x = morton_compact2_(key);
+    *y = morton_compact2_(key >> 1);
+}
+
+// 3 x 16 bits => 48 bits
+static uint64_t inline interleave_bits_3d16(uint16_t x, uint16_t y,
+					    uint16_t z)
+{
+    return morton_spread3_(x) | (morton_spread3_(y) << 1) |
+	(morton_spread3_(z) << 2);
+}
+
+static void inline deinterleave_bits_3d16(uint64_t key, uint16_t* x,
+					  uint16_t* y, uint16_t* z)
+{
+    *x = morton_compact3_(key);
+    *y = morton_compact3_(key >> 1);
+    *z = morton_compact3_(key >> 2);
+}
+
+// 3 x 21 bits => 63 bits
+static uint64_t inline interleave_bits_3d21(uint32_t x, uint32_t y,
+					    uint32_t z)
+{
+    return morton_spread3_(x) | (morton_spread3_(y) << 1) |
+	(morton_spread3_(z) << 2);
+}
+
+static void inline deinterleave_bits_3d21(uint64_t key, uint32_t* x,
+					  uint32_t* y, uint32_t* z)
+{
+    *x = morton_compact3_(key);
+    *y = morton_compact3_(key >> 1);
+    *z = morton_compact3_(key >> 2);
+}
+
+//
+// batch versions over arrays of n coordinates
+//
+static void inline interleave_bits_2d32_array(const uint32_t* x,
+					      const uint32_t* y,
+					      uint64_t* key, size_t n)
+{
+    size_t k;
+    for (k = 0; k < n; k++)
+	key[k] = interleave_bits_2d32(x[k], y[k]);
+}
+
+static void inline deinterleave_bits_2d32_array(const uint64_t* key,
+						uint32_t* x, uint32_t* y,
+						size_t n)
+{
+    size_t k;
+    for (k = 0; k < n; k++)
+	deinterleave_bits_2d32(key[k], &x[k], &y[k]);
+}
+
+static void inline interleave_bits_3d21_array(const uint32_t* x,
+					      const uint32_t* y,
+					      const uint32_t* z,
+					      uint64_t* key, size_t n)
+{
+    size_t k;
+    for (k = 0; k < n; k++)
+	key[k] = interleave_bits_3d21(x[k], y[k], z[k]);
+}
+
+static void inline deinterleave_bits_3d21_array(const uint64_t* key,
+						uint32_t* x, uint32_t* y,
+						uint32_t* z, size_t n)
+{
+    size_t k;
+    for (k = 0; k < n; k++)
+	deinterleave_bits_3d21(key[k], &x[k], &y[k], &z[k]);
+}
+
+//
+// fetch m bits (1 <= m <= 64) starting at bit offset o.
+// little endian: first bit in bit 0, big endian: first bit in bit 63.
+// Only the bytes covering the bits are read.
+//
+static uint64_t inline fetch_bits_(const uint8_t* p, size_t o, size_t m,
+				   int be)
+{
+    size_t b = o >> 3;
+    int s = BIT_OFFSET(o);
+    int nb = (s + m + 7) >> 3;
+    uint64_t x = 0;
+    int i;
+
+    if (nb >= 8) {
+	if (be) {
+	    x = load_be64(p+b) << s;
+	    if (nb > 8)
+		x |= p[b+8] >> (8-s);
+	}
+	else {
+	    x = load_le64(p+b) >> s;
+	    if (nb > 8)
+		x |= (uint64_t) p[b+8] << (64-s);
+	}
+    }
+    else {
+	for (i = 0; i < nb; i++)
+	    x |= be ? ((uint64_t) p[b+i] << (56-8*i))
+		: ((uint64_t) p[b+i] << (8*i));
+	x = be ? (x << s) : (x >> s);
+    }
+    if (m < 64)
+	x &= be ? ~MAKE_MASK64(64-m) : MAKE_MASK64(m);
+    return x;
+}
+
+//
+// find the first differing bit between n bits at a:aoffs and b:boffs.
+// return the bit index relative to the start of the ranges or -1 if
+// the ranges are equal. *cmp is set to -1,0,1 from the value of
+// a's bit at the first difference.
+//
+#define DIFF_BLOCK 256   // bytes compared with memcmp when aligned
+
+static long inline first_diff_bits_(const uint8_t* a, uint32_t aoffs,
+				    const uint8_t* b, uint32_t boffs,
+				    size_t n, int be, int* cmp)
+{
+    size_t i = 0;
+
+    *cmp = 0;
+    while (i < n) {
+	size_t m = ((n - i) < 64) ? (n - i) : 64;
+	uint64_t xa, xb, d;
+
+	// same bit alignment: compare up to a byte boundary,
+	// then skip equal blocks with memcmp
+	if (BIT_OFFSET(aoffs) == BIT_OFFSET(boffs)) {
+	    size_t s = BIT_OFFSET(aoffs+i);
+	    if (s) {
+		if (8 - s < m)
+		    m = 8 - s;
+	    }
+	    else if (m == 64) {
+		const uint8_t* pa = a + ((aoffs+i) >> 3);
+		const uint8_t* pb = b + ((boffs+i) >> 3);
+		while ((n - i >= 8*DIFF_BLOCK) && !memcmp(pa, pb, DIFF_BLOCK)) {
+		    i += 8*DIFF_BLOCK;
+		    pa += DIFF_BLOCK;
+		    pb += DIFF_BLOCK;
+		}
+		m = ((n - i) < 64) ? (n - i) : 64;
+		if (m == 0)
+		    break;
+	    }
+	}
+	xa = fetch_bits_(a, aoffs+i, m, be);
+	xb = fetch_bits_(b, boffs+i, m, be);
+	if ((d = (xa ^ xb)) != 0) {
+	    int k = be ? __builtin_clzll(d) : __builtin_ctzll(d);
+	    int bit = be ? ((xa >> (63-k)) & 1) : ((xa >> k) & 1);
+	    *cmp = bit ? 1 : -1;
+	    return i + k;
+	}
+	i += m;
+    }
+    return -1;
+}
+
+static long inline first_diff_bits_le(const uint8_t* a, uint32_t aoffs,
+				      const uint8_t* b, uint32_t boffs,
+				      size_t n)
+{
+    int cmp;
+    return first_diff_bits_(a, aoffs, b, boffs, n, 0, &cmp);
+}
+
+static long inline first_diff_bits_be(const uint8_t* a, uint32_t aoffs,
+				      const uint8_t* b, uint32_t boffs,
+				      size_t n)
+{
+    int cmp;
+    return first_diff_bits_(a, aoffs, b, boffs, n, 1, &cmp);
+}
+
+//
+// compare n bits at a:aoffs with b:boffs as numbers, return 0 if equal,
+// -1 if a is less than b and 1 if a is greater than b. For little
+// endian the last bit is the most significant and the highest
+// differing bit decide (same order as get_bits_le), for big endian it
+// is the first differing bit.
+//
+static int inline cmp_bits_le(const uint8_t* a, uint32_t aoffs,
+			      const uint8_t* b, uint32_t boffs, size_t n)
+{
+    size_t i = n;
+
+    while (i > 0) {
+	size_t m = (i < 64) ? i : 64;
+	uint64_t xa, xb, d;
+
+	// same bit alignment: compare down to a byte boundary,
+	// then skip equal blocks with memcmp
+	if (BIT_OFFSET(aoffs) == BIT_OFFSET(boffs)) {
+	    size_t s = BIT_OFFSET(aoffs+i);
+	    if (s) {
+		if (s < m)
+		    m = s;
+	    }
+	    else if (m == 64) {
+		const uint8_t* pa = a + ((aoffs+i) >> 3);
+		const uint8_t* pb = b + ((boffs+i) >> 3);
+		while ((i >= 8*DIFF_BLOCK) &&
+		       !memcmp(pa - DIFF_BLOCK, pb - DIFF_BLOCK, DIFF_BLOCK)) {
+		    i -= 8*DIFF_BLOCK;
+		    pa -= DIFF_BLOCK;
+		    pb -= DIFF_BLOCK;
+		}
+		m = (i < 64) ? i : 64;
+		if (m == 0)
+		    break;
+	    }
+	}
+	i -= m;
+	xa = fetch_bits_(a, aoffs+i, m, 0);
+	xb = fetch_bits_(b, boffs+i, m, 0);
+	if ((d = (xa ^ xb)) != 0)
+	    return ((xa >> (63 - __builtin_clzll(d))) & 1) ? 1 : -1;
+    }
+    return 0;
+}
+
+static int inline cmp_bits_be(const uint8_t* a, uint32_t aoffs,
+			      const uint8_t* b, uint32_t boffs, size_t n)
+{
+    int cmp;
+    first_diff_bits_(a, aoffs, b, boffs, n, 1, &cmp);
+    return cmp;
+}
+
 #endif
@@ -0,0 +1,259 @@
+//
+// Growable bit buffer for sequential writing
+//
+// bitbuf_seq_bits_le/be append a field at the write position. Capacity
+// grows geometrically through a pluggable allocator (malloc by default,
+// or a bitarena_t) and BITBUF_PAD bytes are always kept after the
+// capacity so that a field is written with one 64-bit load/store.
+// Like seq_bits only the bits to the left of the write position are
+// preserved. bitbuf_reset rewinds the buffer in O(1) and keeps the
+// memory, so encoding does not allocate once the buffer has grown to
+// the message size.
+//
+
+#ifndef __BITPACK_BUF_H__
+#define __BITPACK_BUF_H__
+
+#include <stdlib.h>
+#include "bitpack.h"
+
+#define BITBUF_PAD      8     // tail padding in bytes
+#define BITBUF_MIN_SIZE 64    // first allocation
+
+typedef struct {
+    void* (*alloc)(void* ctx, size_t size);
+    void  (*free)(void* ctx, void* ptr, size_t size);
+    void*  ctx;
+} bitbuf_allocator_t;
+
+static void* bitbuf_malloc_(void* ctx, size_t size)
+{
+    (void) ctx;
+    return malloc(size);
+}
+
+static void bitbuf_mfree_(void* ctx, void* ptr, size_t size)
+{
+    (void) ctx; (void) size;
+    free(ptr);
+}
+
+//
+// Arena, a bump allocator over a chain of blocks. Free is a no-op and
+// bitarena_reset makes all blocks available again in O(1), memory is
+// only returned by bitarena_destroy. Buffers allocated from the arena
+// are invalid after a reset and must be initialized again.
+//
+typedef struct bitarena_block_s {
+    struct bitarena_block_s* next;
+    size_t size;
+    size_t used;
+} bitarena_block_t;
+
+typedef struct {
+    bitarena_block_t* head;
+    bitarena_block_t* cur;
+    size_t            block_size;
+} bitarena_t;
+
+static void inline bitarena_init(bitarena_t* a, size_t block_size)
+{
+    a->head = NULL;
+    a->cur = NULL;
+    a->block_size = block_size;
+}
+
+static void inline bitarena_reset(bitarena_t* a)
+{
+    a->cur = a->head;
+    if (a->cur)
+	a->cur->used = 0;
+}
+
+static void inline bitarena_destroy(bitarena_t* a)
+{
+    bitarena_block_t* b = a->head;
+    while (b) {
+	bitarena_block_t* next = b->next;
+	free(b);
+	b = next;
+    }
+    a->head = NULL;
+    a->cur = NULL;
+}
+
+static inline void* bitarena_alloc(bitarena_t* a, size_t size)
+{
+    bitarena_block_t* b;
+    uint8_t* p;
+
+    size = (size + 7) & ~(size_t) 7;
+    // use the rest of the current block or move on to a
+    // block kept from before the last reset
+    while (a->cur && (a->cur->used + size > a->cur->size)) {
+	if (!a->cur->next)
+	    break;
+	a->cur = a->cur->next;
+	a->cur->used = 0;
+    }
+    if (!a->cur || (a->cur->used + size > a->cur->size)) {
+	size_t bsize = (size > a->block_size) ? size : a->block_size;
+	b = (bitarena_block_t*) malloc(sizeof(bitarena_block_t) + bsize);
+	if (!b)
+	    return NULL;
+	b->size = bsize;
+	b->used = 0;
+	if (a->cur) {  // append, kept blocks are all used up
+	    b->next = a->cur->next;
+	    a->cur->next = b;
+	}
+	else {
+	    b->next = NULL;
+	    a->head = b;
+	}
+	a->cur = b;
+    }
+    p = (uint8_t*) (a->cur + 1) + a->cur->used;
+    a->cur->used += size;
+    return p;
+}
+
+static void* bitarena_alloc_(void* ctx, size_t size)
+{
+    return bitarena_alloc((bitarena_t*) ctx, size);
+}
+
+static void bitarena_free_(void* ctx, void* ptr, size_t size)
+{
+    (void) ctx; (void) ptr; (void) size;
+}
+
+static void inline bitarena_allocator(bitarena_t* a, bitbuf_allocator_t* al)
+{
+    al->alloc = bitarena_alloc_;
+    al->free = bitarena_free_;
+    al->ctx = a;
+}
+
+typedef struct {
+    uint8_t*           ptr;
+    size_t             size;   // capacity in bytes, padding not included
+    size_t             pos;    // write position in bits
+    bitbuf_allocator_t a;
+} bitbuf_t;
+
+// a is NULL for malloc, size is the initial capacity in bytes (may be 0)
+static int inline bitbuf_init(bitbuf_t* b, const bitbuf_allocator_t* a,
+			      size_t size)
+{
+    if (a)
+	b->a = *a;
+    else {
+	b->a.alloc = bitbuf_malloc_;
+	b->a.free = bitbuf_mfree_;
+	b->a.ctx = NULL;
+    }
+    b->ptr = NULL;
+    b->size = 0;
+    b->pos = 0;
+    if (size) {
+	if (!(b->ptr = (uint8_t*) b->a.alloc(b->a.ctx, size + BITBUF_PAD)))
+	    return -1;
+	b->size = size;
+    }
+    return 0;
+}
+
+static void inline bitbuf_free(bitbuf_t* b)
+{
+    if (b->ptr)
+	b->a.free(b->a.ctx, b->ptr, b->size + BITBUF_PAD);
+    b->ptr = NULL;
+    b->size = 0;
+    b->pos = 0;
+}
+
+static void inline bitbuf_reset(bitbuf_t* b)
+{
+    b->pos = 0;
+}
+
+static size_t inline bitbuf_bits(const bitbuf_t* b)
+{
+    return b->pos;
+}
+
+static size_t inline bitbuf_bytes(const bitbuf_t* b)
+{
+    return (b->pos + 7) >> 3;
+}
+
+// make room for n more bits
+static int inline bitbuf_grow_(bitbuf_t* b, size_t n)
+{
+    size_t need = (b->pos + n + 7) >> 3;
+    size_t size = b->size ? b->size : BITBUF_MIN_SIZE;
+    uint8_t* ptr;
+
+    while (size < need)
+	size <<= 1;
+    if (!(ptr = (uint8_t*) b->a.alloc(b->a.ctx, size + BITBUF_PAD)))
+	return -1;
+    if (b->ptr) {
+	memcpy(ptr, b->ptr, bitbuf_bytes(b));
+	b->a.free(b->a.ctx, b->ptr, b->size + BITBUF_PAD);
+    }
+    b->ptr = ptr;
+    b->size = size;
+    return 0;
+}
+
+static int inline bitbuf_reserve(bitbuf_t* b, size_t n)
+{
+    if (b->pos + n > (b->size << 3))
+	return bitbuf_grow_(b, n);
+    return 0;
+}
+
+// append n (0..32) bits of value
+static int inline bitbuf_seq_bits_le(bitbuf_t* b, uint32_t value, size_t n)
+{
+    uint8_t* p;
+    uint64_t w;
+    int o;
+
+    if (n > 32)
+	return -1;
+    if (n == 0)
+	return 0;
+    if (bitbuf_reserve(b, n) < 0)
+	return -1;
+    p = b->ptr + (b->pos >> 3);
+    o = BIT_OFFSET(b->pos);
+    w = load_le64(p) & MAKE_MASK64(o);
+    store_le64(p, w | ((value & MAKE_MASK64(n)) << o));
+    b->pos += n;
+    return 0;
+}
+
+static int inline bitbuf_seq_bits_be(bitbuf_t* b, uint32_t value, size_t n)
+{
+    uint8_t* p;
+    uint64_t w;
+    int o;
+
+    if (n > 32)
+	return -1;
+    if (n == 0)
+	return 0;
+    if (bitbuf_reserve(b, n) < 0)
+	return -1;
+    p = b->ptr + (b->pos >> 3);
+    o = BIT_OFFSET(b->pos);
+    w = load_be64(p) & ~(~(uint64_t) 0 >> o);
+    store_be64(p, w | ((value & MAKE_MASK64(n)) << (64 - o - n)));
+    b->pos += n;
+    return 0;
+}
+
+#endif
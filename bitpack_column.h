@@ -0,0 +1,164 @@
+//
+// Columnar (SoA) decode and encode of fixed layout packed records
+//
+// Records of stride bits are stored back to back from bit 0. Each
+// field of the layout is decoded into its own column array, one field
+// at a time over all records. Within the loop the record stride is
+// constant, so each value is one unaligned 64-bit load, a shift and a
+// mask (the shift is loop invariant when the stride is a whole number
+// of bytes). Records close to the end of the buffer, where a 64-bit
+// load would read past it, use get_bits/set_bits.
+//
+
+#ifndef __BITPACK_COLUMN_H__
+#define __BITPACK_COLUMN_H__
+
+#include "bitpack.h"
+
+typedef struct {
+    uint32_t offset;   // bit offset within the record
+    uint32_t width;    // 1..32
+    int      sign;     // sign extend on decode
+} bitcol_field_t;
+
+typedef struct {
+    size_t                stride;   // record size in bits
+    int                   be;       // fill order
+    int                   nfields;
+    const bitcol_field_t* field;
+} bitcol_layout_t;
+
+static int inline bitcol_check_(const bitcol_layout_t* l)
+{
+    int k;
+    for (k = 0; k < l->nfields; k++) {
+	const bitcol_field_t* f = &l->field[k];
+	if ((f->width == 0) || (f->width > 32) ||
+	    (f->offset + f->width > l->stride))
+	    return 0;
+    }
+    return 1;
+}
+
+// number of records from the start that can use a 64-bit access
+static size_t inline bitcol_nfast_(const bitcol_layout_t* l, size_t nrec,
+				   const bitcol_field_t* f)
+{
+    size_t nbytes = (nrec * l->stride + 7) >> 3;
+    size_t r = nrec;
+    while (r && ((((r-1) * l->stride + f->offset) >> 3) + 8 > nbytes))
+	r--;
+    return r;
+}
+
+static uint32_t inline bitcol_sign_(uint32_t v, uint32_t width)
+{
+    return (uint32_t) (((int32_t) (v << (32-width))) >> (32-width));
+}
+
+//
+// decode nrec records from src into cols[k] for field k
+//
+static int inline decode_columns(const bitcol_layout_t* l,
+				 const uint8_t* src, size_t nrec,
+				 uint32_t** cols)
+{
+    int k;
+
+    if (!bitcol_check_(l))
+	return -1;
+    for (k = 0; k < l->nfields; k++) {
+	const bitcol_field_t* f = &l->field[k];
+	uint32_t* col = cols[k];
+	uint64_t mask = MAKE_MASK64(f->width);
+	size_t nfast = bitcol_nfast_(l, nrec, f);
+	size_t r;
+
+	if (!BIT_OFFSET(l->stride)) {  // constant shift
+	    const uint8_t* p = src + (f->offset >> 3);
+	    size_t step = l->stride >> 3;
+	    int s = l->be ? (64 - BIT_OFFSET(f->offset) - f->width)
+		: BIT_OFFSET(f->offset);
+	    if (l->be) {
+		for (r = 0; r < nfast; r++, p += step)
+		    col[r] = (load_be64(p) >> s) & mask;
+	    }
+	    else {
+		for (r = 0; r < nfast; r++, p += step)
+		    col[r] = (load_le64(p) >> s) & mask;
+	    }
+	}
+	else {
+	    size_t o = f->offset;
+	    for (r = 0; r < nfast; r++, o += l->stride) {
+		if (l->be)
+		    col[r] = (load_be64(src + (o >> 3)) >>
+			      (64 - BIT_OFFSET(o) - f->width)) & mask;
+		else
+		    col[r] = (load_le64(src + (o >> 3)) >> BIT_OFFSET(o)) & mask;
+	    }
+	}
+	// tail, step the pointer so the bit offset stays below 8
+	for (r = nfast; r < nrec; r++) {
+	    size_t o = r * l->stride + f->offset;
+	    uint64_t v = 0;
+	    if (l->be)
+		get_bits_be64(src + (o >> 3), &v, BIT_OFFSET(o), f->width);
+	    else
+		get_bits_le64(src + (o >> 3), &v, BIT_OFFSET(o), f->width);
+	    col[r] = v;
+	}
+	if (f->sign) {
+	    for (r = 0; r < nrec; r++)
+		col[r] = bitcol_sign_(col[r], f->width);
+	}
+    }
+    return nrec;
+}
+
+//
+// encode nrec records into dst from cols[k] for field k,
+// bits not covered by any field are left as is
+//
+static int inline encode_columns(const bitcol_layout_t* l,
+				 uint32_t* const* cols, size_t nrec,
+				 uint8_t* dst)
+{
+    int k;
+
+    if (!bitcol_check_(l))
+	return -1;
+    for (k = 0; k < l->nfields; k++) {
+	const bitcol_field_t* f = &l->field[k];
+	const uint32_t* col = cols[k];
+	uint64_t mask = MAKE_MASK64(f->width);
+	size_t nfast = bitcol_nfast_(l, nrec, f);
+	size_t o = f->offset;
+	size_t r;
+
+	for (r = 0; r < nfast; r++, o += l->stride) {
+	    uint8_t* p = dst + (o >> 3);
+	    if (l->be) {
+		int s = 64 - BIT_OFFSET(o) - f->width;
+		uint64_t w = load_be64(p);
+		store_be64(p, MASK_BITS((col[r] & mask) << s, w, mask << s));
+	    }
+	    else {
+		int s = BIT_OFFSET(o);
+		uint64_t w = load_le64(p);
+		store_le64(p, MASK_BITS((col[r] & mask) << s, w, mask << s));
+	    }
+	}
+	// tail, step the pointer so the bit offset stays below 8
+	for (r = nfast; r < nrec; r++, o += l->stride) {
+	    uint8_t* p = dst + (o >> 3);
+	    if (l->be)
+		set_bits_be64(p, col[r] & mask, BIT_OFFSET(o), f->width);
+	    else
+		set_bits_le64(p, col[r] & mask, BIT_OFFSET(o), f->width);
+	}
+    }
+    return nrec;
+}
+
+#endif
@@ -0,0 +1,306 @@
+//
+// CRC calculation fused with bit packing and copying
+//
+// The CRC is computed over the bit stream in the fill order of the
+// operation, little endian streams bit 0 of each byte first and big
+// endian streams bit 7 first. Whole bytes go through a 256 entry table
+// (or the SSE4.2 crc32 instruction for CRC-32C on little endian
+// streams), partial bytes are shifted in one bit at a time.
+//
+// The crc value passed around is the raw register, start with
+// crc_begin() and apply the final xor with crc_end().
+//
+
+#ifndef __BITPACK_CRC_H__
+#define __BITPACK_CRC_H__
+
+#include "bitpack.h"
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+typedef struct {
+    int      width;      // crc width in bits (8..32)
+    uint32_t poly;       // polynomial, normal (msb first) form
+    uint32_t init;       // initial register
+    uint32_t xorout;     // final xor
+    int      refl;       // reflected (lsb first) algorithm
+    int      ready;      // table state, 0 empty, 1 building, 2 ready
+    uint32_t table[256];
+} crc_def_t;
+
+// catalog parameters, "123456789" check values in the test,
+// weak so all translation units share one table per polynomial
+__attribute__((weak)) crc_def_t crc32c_def =
+    { 32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, 1, 0, {0} };
+__attribute__((weak)) crc_def_t crc15_can_def =
+    { 15, 0x4599, 0, 0, 0, 0, {0} };
+__attribute__((weak)) crc_def_t crc17_canfd_def =
+    { 17, 0x1685B, 0, 0, 0, 0, {0} };
+
+#define CRC_MASK(def) \
+    (((def)->width == 32) ? 0xFFFFFFFF : ((((uint32_t) 1) << (def)->width)-1))
+
+static uint8_t inline rev8_(uint8_t b)
+{
+    return ((b * 0x0202020202ULL) & 0x010884422010ULL) % 1023;
+}
+
+static uint32_t inline rev_bits_(uint32_t x, int n)
+{
+    uint32_t r = 0;
+    while (n--) {
+	r = (r << 1) | (x & 1);
+	x >>= 1;
+    }
+    return r;
+}
+
+static int inline crc_ready_(crc_def_t* def)
+{
+    return __atomic_load_n(&def->ready, __ATOMIC_ACQUIRE) == 2;
+}
+
+//
+// fill in the table once, the first caller builds it and publishes it
+// with a release store, other callers wait until it is ready
+//
+static void inline crc_init_(crc_def_t* def)
+{
+    uint32_t mask = CRC_MASK(def);
+    uint32_t rpoly = rev_bits_(def->poly, def->width);
+    uint32_t top = ((uint32_t) 1) << (def->width-1);
+    int state = 0;
+    int i, k;
+
+    if (!__atomic_compare_exchange_n(&def->ready, &state, 1, 0,
+				     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+	while (!crc_ready_(def))
+	    ;
+	return;
+    }
+    for (i = 0; i < 256; i++) {
+	uint32_t r;
+	if (def->refl) {
+	    r = i;
+	    for (k = 0; k < 8; k++)
+		r = (r & 1) ? ((r >> 1) ^ rpoly) : (r >> 1);
+	}
+	else {
+	    r = (uint32_t) i << (def->width-8);
+	    for (k = 0; k < 8; k++)
+		r = (r & top) ? ((r << 1) ^ def->poly) : (r << 1);
+	}
+	def->table[i] = r & mask;
+    }
+    __atomic_store_n(&def->ready, 2, __ATOMIC_RELEASE);
+}
+
+static uint32_t inline crc_begin(crc_def_t* def)
+{
+    if (!crc_ready_(def))
+	crc_init_(def);
+    return def->init;
+}
+
+static uint32_t inline crc_end(const crc_def_t* def, uint32_t crc)
+{
+    return (crc ^ def->xorout) & CRC_MASK(def);
+}
+
+// shift in one bit
+static uint32_t inline crc_bit_(const crc_def_t* def, uint32_t crc, int b)
+{
+    if (def->refl) {
+	crc ^= (b & 1);
+	return (crc & 1) ? ((crc >> 1) ^ rev_bits_(def->poly, def->width))
+	    : (crc >> 1);
+    }
+    else {
+	int top = ((crc >> (def->width-1)) ^ b) & 1;
+	crc = (crc << 1) & CRC_MASK(def);
+	return top ? (crc ^ def->poly) : crc;
+    }
+}
+
+// shift in one byte given in stream order (lsb first if le)
+static uint32_t inline crc_byte_(const crc_def_t* def, uint32_t crc,
+				 uint8_t b, int be)
+{
+    if (def->refl) {
+	if (be) b = rev8_(b);
+	return (crc >> 8) ^ def->table[(crc ^ b) & 0xff];
+    }
+    if (!be) b = rev8_(b);
+    return ((crc << 8) ^ def->table[((crc >> (def->width-8)) ^ b) & 0xff])
+	& CRC_MASK(def);
+}
+
+static uint32_t inline crc_bytes_(const crc_def_t* def, uint32_t crc,
+				  const uint8_t* p, size_t n, int be)
+{
+#ifdef __SSE4_2__
+    if ((def == &crc32c_def) && !be) {
+	uint64_t c = crc;
+	while (n >= 8) {
+	    uint64_t w;
+	    memcpy(&w, p, 8);
+	    c = _mm_crc32_u64(c, w);
+	    p += 8;
+	    n -= 8;
+	}
+	crc = c;
+	while (n--)
+	    crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+    }
+#endif
+    while (n--)
+	crc = crc_byte_(def, crc, *p++, be);
+    return crc;
+}
+
+//
+// update crc with n bits at p:offs in little/big endian fill order
+//
+static uint32_t inline crc_update_bits_(crc_def_t* def, uint32_t crc,
+					const uint8_t* p, size_t offs,
+					size_t n, int be)
+{
+    size_t i = 0;
+
+    if (!crc_ready_(def))
+	crc_init_(def);
+    if (!BIT_OFFSET(offs)) {
+	crc = crc_bytes_(def, crc, p + (offs >> 3), n >> 3, be);
+	i = n & ~(size_t) 7;
+    }
+    else {
+	uint8_t buf[8];
+	for (; i + 64 <= n; i += 64) {
+	    uint64_t w = fetch_bits_(p, offs+i, 64, be);
+	    if (be) store_be64(buf, w); else store_le64(buf, w);
+	    crc = crc_bytes_(def, crc, buf, 8, be);
+	}
+    }
+    for (; i < n; i++) {
+	int b = be ? get_bit_be(p, offs+i) : get_bit_le(p, offs+i);
+	crc = crc_bit_(def, crc, b);
+    }
+    return crc;
+}
+
+static uint32_t inline crc_update_bits_le(crc_def_t* def, uint32_t crc,
+					  const uint8_t* p, size_t offs,
+					  size_t n)
+{
+    return crc_update_bits_(def, crc, p, offs, n, 0);
+}
+
+static uint32_t inline crc_update_bits_be(crc_def_t* def, uint32_t crc,
+					  const uint8_t* p, size_t offs,
+					  size_t n)
+{
+    return crc_update_bits_(def, crc, p, offs, n, 1);
+}
+
+//
+// copy n bits and update *crc with the copied bits. The copy is done
+// in blocks small enough to stay in L1, and each block is checksummed
+// right after it is copied (from the side that is byte aligned).
+// Return n.
+//
+#define CRC_COPY_BLOCK 2048   // bits
+
+static size_t inline copy_bits_crc_(uint8_t* src, uint32_t soffs,
+				    uint8_t* dst, uint32_t doffs, size_t n,
+				    crc_def_t* def, uint32_t* crc, int be)
+{
+    uint32_t c = *crc;
+    size_t i;
+
+    for (i = 0; i < n; i += CRC_COPY_BLOCK) {
+	size_t m = (n - i < CRC_COPY_BLOCK) ? (n - i) : CRC_COPY_BLOCK;
+	if (be)
+	    copy_bits_be(src, soffs+i, dst, doffs+i, m);
+	else
+	    copy_bits_le(src, soffs+i, dst, doffs+i, m);
+	if (!BIT_OFFSET(doffs+i))
+	    c = crc_update_bits_(def, c, dst, doffs+i, m, be);
+	else
+	    c = crc_update_bits_(def, c, src, soffs+i, m, be);
+    }
+    *crc = c;
+    return n;
+}
+
+static size_t inline copy_bits_crc_le(uint8_t* src, uint32_t soffs,
+				      uint8_t* dst, uint32_t doffs, size_t n,
+				      crc_def_t* def, uint32_t* crc)
+{
+    return copy_bits_crc_(src, soffs, dst, doffs, n, def, crc, 0);
+}
+
+static size_t inline copy_bits_crc_be(uint8_t* src, uint32_t soffs,
+				      uint8_t* dst, uint32_t doffs, size_t n,
+				      crc_def_t* def, uint32_t* crc)
+{
+    return copy_bits_crc_(src, soffs, dst, doffs, n, def, crc, 1);
+}
+
+//
+// checksumming sequential bit writer. Values are written with
+// seq_bits_le/be and every byte is added to the crc as soon as it
+// is complete.
+//
+typedef struct {
+    uint8_t*   ptr;    // output buffer
+    int        pos;    // next bit position
+    int        done;   // bits included in crc
+    int        be;     // fill order
+    crc_def_t* def;
+    uint32_t   crc;
+} crc_writer_t;
+
+static void inline crc_writer_init(crc_writer_t* w, uint8_t* ptr, int pos,
+				   crc_def_t* def, int be)
+{
+    w->ptr = ptr;
+    w->pos = pos;
+    w->done = pos;
+    w->be = be;
+    w->def = def;
+    w->crc = crc_begin(def);
+}
+
+static int inline crc_writer_put(crc_writer_t* w, uint32_t value, size_t n)
+{
+    int full;
+
+    if (w->be)
+	w->pos = seq_bits_be(w->ptr, value, w->pos, n);
+    else
+	w->pos = seq_bits_le(w->ptr, value, w->pos, n);
+    // checksum complete bytes only, the last byte may still change
+    full = w->pos & ~7;
+    if (full > w->done) {
+	w->crc = crc_update_bits_(w->def, w->crc, w->ptr, w->done,
+				  full - w->done, w->be);
+	w->done = full;
+    }
+    return w->pos;
+}
+
+// include the remaining bits and return the final crc
+static uint32_t inline crc_writer_finish(crc_writer_t* w)
+{
+    if (w->pos > w->done) {
+	w->crc = crc_update_bits_(w->def, w->crc, w->ptr, w->done,
+				  w->pos - w->done, w->be);
+	w->done = w->pos;
+    }
+    return crc_end(w->def, w->crc);
+}
+
+#endif
@@ -0,0 +1,444 @@
+//
+// Packed columnar files
+//
+// Rows are written in groups. Each column of a group is one block of
+// value - min packed with seq_bits_le at the smallest width that holds
+// max - min, min and max are kept as block statistics. A footer at the
+// end of the file describes the columns and indexes all blocks, so a
+// reader only touches the blocks a query needs.
+//
+// File layout (integers little endian):
+//   "BPKF" u32 version
+//   blocks: packed bits followed by BITFILE_PAD zero bytes
+//   footer:
+//     u32 ncols, ncols * (u16 length, name bytes)
+//     u64 ngroups, ngroups * (u64 nrows, ncols * block)
+//       block: u64 offset, u64 size, u32 min, u32 max, u8 width
+//     u64 footer offset
+//     "BPKF"
+//
+// The reader maps the file. bitfile_skip checks the block statistics
+// against a range, bitfile_select evaluates the range on the packed
+// bits (scan_range_le) and bitfile_read / bitfile_read_sel decode a
+// block, or the selected rows of it, with 64-bit loads. The padding
+// after each block keeps those loads inside the file.
+//
+
+#ifndef __BITPACK_FILE_H__
+#define __BITPACK_FILE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitpack.h"
+#include "bitpack_buf.h"
+#include "bitpack_column.h"
+#include "bitpack_scan.h"
+
+#define BITFILE_MAGIC    "BPKF"
+#define BITFILE_VERSION  1
+#define BITFILE_PAD      8
+#define BITFILE_MAX_ROWS (1 << 24)    // rows per group
+#define BITFILE_MAX_COLS 4096
+#define BITFILE_BLOCK    25           // block size in the footer
+
+typedef struct {
+    uint64_t offset;   // file offset of the packed values
+    uint64_t size;     // bytes, padding not included
+    uint32_t min;
+    uint32_t max;
+    uint8_t  width;    // 0 when all values are min
+} bitfile_block_t;
+
+typedef struct {
+    FILE*            f;
+    int              ncols;
+    char**           names;
+    uint64_t         pos;       // file offset
+    size_t           ngroups;
+    size_t           cap;
+    uint64_t*        nrows;     // per group
+    bitfile_block_t* block;     // ngroups * ncols
+    bitbuf_t         buf;
+} bitfile_writer_t;
+
+typedef struct {
+    int              fd;
+    uint8_t*         map;
+    size_t           size;
+    int              ncols;
+    char**           names;
+    size_t           ngroups;
+    uint64_t*        nrows;
+    bitfile_block_t* block;
+} bitfile_t;
+
+static void inline bitfile_free_names_(char** names, int ncols)
+{
+    int k;
+    if (!names)
+	return;
+    for (k = 0; k < ncols; k++)
+	free(names[k]);
+    free(names);
+}
+
+//
+// writer
+//
+static int inline bitfile_put_(bitfile_writer_t* w, const void* ptr,
+			       size_t n)
+{
+    if (fwrite(ptr, 1, n, w->f) != n)
+	return -1;
+    w->pos += n;
+    return 0;
+}
+
+static int inline bitfile_put32_(bitfile_writer_t* w, uint32_t v)
+{
+    uint8_t b[4];
+    store_le32(b, v);
+    return bitfile_put_(w, b, 4);
+}
+
+static int inline bitfile_put64_(bitfile_writer_t* w, uint64_t v)
+{
+    uint8_t b[8];
+    store_le64(b, v);
+    return bitfile_put_(w, b, 8);
+}
+
+static int inline bitfile_create(bitfile_writer_t* w, const char* path,
+				 int ncols, const char* const* names)
+{
+    int k;
+
+    memset(w, 0, sizeof(bitfile_writer_t));
+    if ((ncols <= 0) || (ncols > BITFILE_MAX_COLS))
+	return -1;
+    if (!(w->names = (char**) calloc(ncols, sizeof(char*))))
+	return -1;
+    w->ncols = ncols;
+    for (k = 0; k < ncols; k++) {  // strdup is not in c99
+	size_t len = strlen(names[k]);
+	if ((len > 0xffff) || !(w->names[k] = (char*) malloc(len + 1)))
+	    goto error;
+	memcpy(w->names[k], names[k], len + 1);
+    }
+    if (bitbuf_init(&w->buf, NULL, 0) < 0)
+	goto error;
+    if (!(w->f = fopen(path, "wb")))
+	goto error;
+    if ((bitfile_put_(w, BITFILE_MAGIC, 4) < 0) ||
+	(bitfile_put32_(w, BITFILE_VERSION) < 0)) {
+	fclose(w->f);
+	goto error;
+    }
+    return 0;
+error:
+    bitfile_free_names_(w->names, ncols);
+    bitbuf_free(&w->buf);
+    w->names = NULL;
+    return -1;
+}
+
+// write nrows rows, cols[k] holds the values of column k
+static int inline bitfile_write_group(bitfile_writer_t* w,
+				      const uint32_t* const* cols,
+				      size_t nrows)
+{
+    static const uint8_t pad[BITFILE_PAD] = { 0 };
+    bitfile_block_t* b;
+    size_t i;
+    int k;
+
+    if ((nrows == 0) || (nrows > BITFILE_MAX_ROWS))
+	return -1;
+    if (w->ngroups == w->cap) {
+	size_t cap = w->cap ? 2*w->cap : 16;
+	uint64_t* nr = (uint64_t*) realloc(w->nrows, cap*sizeof(uint64_t));
+	if (!nr)
+	    return -1;
+	w->nrows = nr;
+	b = (bitfile_block_t*)
+	    realloc(w->block, cap*w->ncols*sizeof(bitfile_block_t));
+	if (!b)
+	    return -1;
+	w->block = b;
+	w->cap = cap;
+    }
+    b = &w->block[w->ngroups*w->ncols];
+    for (k = 0; k < w->ncols; k++, b++) {
+	const uint32_t* v = cols[k];
+	uint32_t min = v[0], max = v[0];
+	for (i = 1; i < nrows; i++) {
+	    if (v[i] < min) min = v[i];
+	    if (v[i] > max) max = v[i];
+	}
+	b->min = min;
+	b->max = max;
+	b->width = (max == min) ? 0 : 32 - __builtin_clz(max - min);
+	b->offset = w->pos;
+	bitbuf_reset(&w->buf);
+	if (b->width) {
+	    if (bitbuf_reserve(&w->buf, nrows * b->width) < 0)
+		return -1;
+	    for (i = 0; i < nrows; i++)
+		bitbuf_seq_bits_le(&w->buf, v[i] - min, b->width);
+	}
+	b->size = bitbuf_bytes(&w->buf);
+	if ((b->size && (bitfile_put_(w, w->buf.ptr, b->size) < 0)) ||
+	    (bitfile_put_(w, pad, BITFILE_PAD) < 0))
+	    return -1;
+    }
+    w->nrows[w->ngroups++] = nrows;
+    return 0;
+}
+
+// write the footer and close the file
+static int inline bitfile_finish(bitfile_writer_t* w)
+{
+    uint64_t footer = w->pos;
+    int res = 0;
+    size_t g;
+    int k;
+
+    res |= bitfile_put32_(w, w->ncols);
+    for (k = 0; k < w->ncols; k++) {
+	uint8_t b[2];
+	size_t len = strlen(w->names[k]);
+	store_le16(b, len);
+	res |= bitfile_put_(w, b, 2);
+	res |= bitfile_put_(w, w->names[k], len);
+    }
+    res |= bitfile_put64_(w, w->ngroups);
+    for (g = 0; g < w->ngroups; g++) {
+	res |= bitfile_put64_(w, w->nrows[g]);
+	for (k = 0; k < w->ncols; k++) {
+	    const bitfile_block_t* b = &w->block[g*w->ncols + k];
+	    res |= bitfile_put64_(w, b->offset);
+	    res |= bitfile_put64_(w, b->size);
+	    res |= bitfile_put32_(w, b->min);
+	    res |= bitfile_put32_(w, b->max);
+	    res |= bitfile_put_(w, &b->width, 1);
+	}
+    }
+    res |= bitfile_put64_(w, footer);
+    res |= bitfile_put_(w, BITFILE_MAGIC, 4);
+    if (fclose(w->f) != 0)
+	res = -1;
+    bitfile_free_names_(w->names, w->ncols);
+    free(w->nrows);
+    free(w->block);
+    bitbuf_free(&w->buf);
+    memset(w, 0, sizeof(bitfile_writer_t));
+    return res ? -1 : 0;
+}
+
+//
+// reader
+//
+static void inline bitfile_close(bitfile_t* r)
+{
+    if (r->map)
+	munmap(r->map, r->size);
+    if (r->fd >= 0)
+	close(r->fd);
+    bitfile_free_names_(r->names, r->ncols);
+    free(r->nrows);
+    free(r->block);
+    memset(r, 0, sizeof(bitfile_t));
+    r->fd = -1;
+}
+
+static int inline bitfile_open(bitfile_t* r, const char* path)
+{
+    struct stat st;
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t footer;
+    size_t g;
+    int k;
+
+    memset(r, 0, sizeof(bitfile_t));
+    if ((r->fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    if ((fstat(r->fd, &st) < 0) || (st.st_size < 8 + 4 + 8 + 8 + 4))
+	goto error;
+    r->size = st.st_size;
+    r->map = (uint8_t*) mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (r->map == MAP_FAILED) {
+	r->map = NULL;
+	goto error;
+    }
+    end = r->map + r->size - 12;
+    if ((memcmp(r->map, BITFILE_MAGIC, 4) != 0) ||
+	(load_le32(r->map + 4) != BITFILE_VERSION) ||
+	(memcmp(end + 8, BITFILE_MAGIC, 4) != 0))
+	goto error;
+    footer = load_le64(end);
+    if ((footer < 8) || (footer + 4 + 8 > r->size - 12))
+	goto error;
+    p = r->map + footer;
+    r->ncols = load_le32(p); p += 4;
+    if ((r->ncols <= 0) || (r->ncols > BITFILE_MAX_COLS) ||
+	!(r->names = (char**) calloc(r->ncols, sizeof(char*))))
+	goto error;
+    for (k = 0; k < r->ncols; k++) {
+	size_t len;
+	if (p + 2 > end)
+	    goto error;
+	len = load_le16(p); p += 2;
+	if ((p + len > end) || !(r->names[k] = (char*) malloc(len + 1)))
+	    goto error;
+	memcpy(r->names[k], p, len);
+	r->names[k][len] = '\0';
+	p += len;
+    }
+    if (p + 8 > end)
+	goto error;
+    r->ngroups = load_le64(p); p += 8;
+    if (r->ngroups > (size_t) (end - p) / (8 + BITFILE_BLOCK*r->ncols))
+	goto error;
+    r->nrows = (uint64_t*) malloc((r->ngroups + 1)*sizeof(uint64_t));
+    r->block = (bitfile_block_t*)
+	malloc((r->ngroups*r->ncols + 1)*sizeof(bitfile_block_t));
+    if (!r->nrows || !r->block)
+	goto error;
+    for (g = 0; g < r->ngroups; g++) {
+	r->nrows[g] = load_le64(p); p += 8;
+	if ((r->nrows[g] == 0) || (r->nrows[g] > BITFILE_MAX_ROWS))
+	    goto error;
+	for (k = 0; k < r->ncols; k++) {
+	    bitfile_block_t* b = &r->block[g*r->ncols + k];
+	    b->offset = load_le64(p);
+	    b->size = load_le64(p + 8);
+	    b->min = load_le32(p + 16);
+	    b->max = load_le32(p + 20);
+	    b->width = p[24];
+	    p += BITFILE_BLOCK;
+	    if ((b->width > 32) || (b->offset < 8) ||
+		(b->size > footer) ||
+		(b->offset + b->size + BITFILE_PAD > footer) ||
+		(b->size < (r->nrows[g]*b->width + 7) >> 3))
+		goto error;
+	}
+    }
+    return 0;
+error:
+    bitfile_close(r);
+    return -1;
+}
+
+// column index, -1 if not found
+static int inline bitfile_column(const bitfile_t* r, const char* name)
+{
+    int k;
+    for (k = 0; k < r->ncols; k++) {
+	if (strcmp(r->names[k], name) == 0)
+	    return k;
+    }
+    return -1;
+}
+
+static inline const bitfile_block_t* bitfile_block(const bitfile_t* r,
+						   size_t g, int k)
+{
+    return &r->block[g*r->ncols + k];
+}
+
+// 1 if no value in column k of group g is in lo .. hi
+static int inline bitfile_skip(const bitfile_t* r, size_t g, int k,
+			       uint32_t lo, uint32_t hi)
+{
+    const bitfile_block_t* b = bitfile_block(r, g, k);
+    return (b->max < lo) || (b->min > hi) || (lo > hi);
+}
+
+// decode column k of group g into out, return nrows or -1
+static long inline bitfile_read(const bitfile_t* r, size_t g, int k,
+				uint32_t* out)
+{
+    const bitfile_block_t* b = bitfile_block(r, g, k);
+    size_t i, n = r->nrows[g];
+
+    if (b->width == 0) {
+	for (i = 0; i < n; i++)
+	    out[i] = b->min;
+    }
+    else {
+	bitcol_field_t f = { 0, b->width, 0 };
+	bitcol_layout_t l = { b->width, 0, 1, &f };
+	if (decode_columns(&l, r->map + b->offset, n, &out) < 0)
+	    return -1;
+	if (b->min) {
+	    for (i = 0; i < n; i++)
+		out[i] += b->min;
+	}
+    }
+    return n;
+}
+
+//
+// selection bitmap (le) of the rows of group g with lo <= column k <= hi
+//
+static int inline bitfile_select(const bitfile_t* r, size_t g, int k,
+				 uint32_t lo, uint32_t hi, uint8_t* bitmap)
+{
+    const bitfile_block_t* b = bitfile_block(r, g, k);
+    size_t n = r->nrows[g];
+
+    if (bitfile_skip(r, g, k, lo, hi)) {
+	memset(bitmap, 0, (n + 7) >> 3);
+	return 0;
+    }
+    if (b->width == 0) {  // all values in range
+	memset(bitmap, 0xff, n >> 3);
+	if (n & 7)
+	    bitmap[n >> 3] = MAKE_MASK(n & 7);
+	return 0;
+    }
+    lo = (lo > b->min) ? lo - b->min : 0;
+    hi = hi - b->min;
+    return scan_range_le(r->map + b->offset, n, b->width, lo, hi, bitmap);
+}
+
+// decode the rows of column k of group g selected in bitmap, return count
+static long inline bitfile_read_sel(const bitfile_t* r, size_t g, int k,
+				    const uint8_t* bitmap, uint32_t* out)
+{
+    const bitfile_block_t* b = bitfile_block(r, g, k);
+    const uint8_t* src = r->map + b->offset;
+    uint64_t mask = MAKE_MASK64(b->width);
+    size_t n = r->nrows[g];
+    size_t i, nw = (n + 63) >> 6;
+    long count = 0;
+
+    for (i = 0; i < nw; i++) {
+	uint64_t m;
+	if (8*i + 8 <= ((n + 7) >> 3))
+	    m = load_le64(bitmap + 8*i);
+	else {
+	    uint8_t tmp[8];
+	    memset(tmp, 0, 8);
+	    memcpy(tmp, bitmap + 8*i, ((n + 7) >> 3) - 8*i);
+	    m = load_le64(tmp);
+	}
+	while (m) {
+	    size_t row = 64*i + __builtin_ctzll(m);
+	    size_t o = row * b->width;
+	    uint32_t v = 0;
+	    if (b->width)  // padding after the block covers the load
+		v = (load_le64(src + (o >> 3)) >> BIT_OFFSET(o)) & mask;
+	    out[count++] = v + b->min;
+	    m &= m - 1;
+	}
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,261 @@
+//
+// Bit access over chains of buffer segments (scatter/gather)
+//
+// A bitiov_t describe the concatenation of an array of segments.
+// Bit offsets are relative to the start of the first segment.
+// Ranges inside one segment go straight to the contiguous functions,
+// fields that straddle segment boundaries are split at the boundary.
+// The iov remembers the last segment used, so sequential access does
+// not search from the start.
+//
+
+#ifndef __BITPACK_IOV_H__
+#define __BITPACK_IOV_H__
+
+#include "bitpack.h"
+
+typedef struct {
+    uint8_t* base;
+    size_t   len;     // bytes
+} bitseg_t;
+
+typedef struct {
+    bitseg_t* seg;
+    int       nseg;
+    int       cur;     // current segment
+    size_t    start;   // bit offset of current segment
+    size_t    pos;     // position for read_bits/write_bits
+} bitiov_t;
+
+static void inline bitiov_init(bitiov_t* v, bitseg_t* seg, int nseg)
+{
+    v->seg = seg;
+    v->nseg = nseg;
+    v->cur = 0;
+    v->start = 0;
+    v->pos = 0;
+}
+
+static size_t inline bitiov_bits(const bitiov_t* v)
+{
+    size_t n = 0;
+    int i;
+    for (i = 0; i < v->nseg; i++)
+	n += v->seg[i].len;
+    return n << 3;
+}
+
+// make the segment holding bit offs current, return 0 if out of range
+static int inline bitiov_seek_(bitiov_t* v, size_t offs)
+{
+    while ((v->cur > 0) && (offs < v->start)) {
+	v->cur--;
+	v->start -= v->seg[v->cur].len << 3;
+    }
+    while ((v->cur < v->nseg) &&
+	   (offs >= v->start + (v->seg[v->cur].len << 3))) {
+	v->start += v->seg[v->cur].len << 3;
+	v->cur++;
+    }
+    return v->cur < v->nseg;
+}
+
+//
+// copy n bits from the iov at soffs to dst:doffs
+//
+static long inline copy_bits_from_iov_(bitiov_t* v, size_t soffs,
+				       uint8_t* dst, uint32_t doffs,
+				       size_t n, int be)
+{
+    size_t r = n;
+
+    while (n) {
+	bitseg_t* seg;
+	size_t local, m;
+	if (!bitiov_seek_(v, soffs))
+	    return -1;
+	seg = &v->seg[v->cur];
+	local = soffs - v->start;
+	m = (seg->len << 3) - local;
+	if (m > n)
+	    m = n;
+	if (be)
+	    copy_bits_be(seg->base, local, dst, doffs, m);
+	else
+	    copy_bits_le(seg->base, local, dst, doffs, m);
+	soffs += m;
+	doffs += m;
+	n -= m;
+    }
+    return r;
+}
+
+//
+// copy n bits from src:soffs to the iov at doffs
+//
+static long inline copy_bits_to_iov_(uint8_t* src, uint32_t soffs,
+				     bitiov_t* v, size_t doffs,
+				     size_t n, int be)
+{
+    size_t r = n;
+
+    while (n) {
+	bitseg_t* seg;
+	size_t local, m;
+	if (!bitiov_seek_(v, doffs))
+	    return -1;
+	seg = &v->seg[v->cur];
+	local = doffs - v->start;
+	m = (seg->len << 3) - local;
+	if (m > n)
+	    m = n;
+	if (be)
+	    copy_bits_be(src, soffs, seg->base, local, m);
+	else
+	    copy_bits_le(src, soffs, seg->base, local, m);
+	soffs += m;
+	doffs += m;
+	n -= m;
+    }
+    return r;
+}
+
+static long inline get_bits_iov_(bitiov_t* v, uint32_t* value,
+				 size_t i, size_t n, int be)
+{
+    uint8_t tmp[5] = { 0 };
+    bitseg_t* seg;
+
+    if (n > 32)
+	return -1;
+    if (!bitiov_seek_(v, i))
+	return -1;
+    seg = &v->seg[v->cur];
+    if (i + n <= v->start + (seg->len << 3)) {  // inside one segment
+	size_t local = i - v->start;
+	if (be)
+	    get_bits_be(seg->base, value, local, n);
+	else
+	    get_bits_le(seg->base, value, local, n);
+	return i + n;
+    }
+    // straddle, collect the bits in tmp at the same bit offset
+    if (copy_bits_from_iov_(v, i, tmp, BIT_OFFSET(i), n, be) < 0)
+	return -1;
+    if (be)
+	get_bits_be(tmp, value, BIT_OFFSET(i), n);
+    else
+	get_bits_le(tmp, value, BIT_OFFSET(i), n);
+    return i + n;
+}
+
+static long inline set_bits_iov_(bitiov_t* v, uint32_t value,
+				 size_t i, size_t n, int be)
+{
+    uint8_t tmp[5] = { 0 };
+    bitseg_t* seg;
+
+    if (n > 32)
+	return -1;
+    if (!bitiov_seek_(v, i))
+	return -1;
+    seg = &v->seg[v->cur];
+    if (i + n <= v->start + (seg->len << 3)) {
+	size_t local = i - v->start;
+	if (be)
+	    set_bits_be(seg->base, value, local, n);
+	else
+	    set_bits_le(seg->base, value, local, n);
+	return i + n;
+    }
+    if (be)
+	set_bits_be(tmp, value, BIT_OFFSET(i), n);
+    else
+	set_bits_le(tmp, value, BIT_OFFSET(i), n);
+    if (copy_bits_to_iov_(tmp, BIT_OFFSET(i), v, i, n, be) < 0)
+	return -1;
+    return i + n;
+}
+
+static long inline copy_bits_from_iov_le(bitiov_t* v, size_t soffs,
+					 uint8_t* dst, uint32_t doffs,
+					 size_t n)
+{
+    return copy_bits_from_iov_(v, soffs, dst, doffs, n, 0);
+}
+
+static long inline copy_bits_from_iov_be(bitiov_t* v, size_t soffs,
+					 uint8_t* dst, uint32_t doffs,
+					 size_t n)
+{
+    return copy_bits_from_iov_(v, soffs, dst, doffs, n, 1);
+}
+
+static long inline copy_bits_to_iov_le(uint8_t* src, uint32_t soffs,
+				       bitiov_t* v, size_t doffs, size_t n)
+{
+    return copy_bits_to_iov_(src, soffs, v, doffs, n, 0);
+}
+
+static long inline copy_bits_to_iov_be(uint8_t* src, uint32_t soffs,
+				       bitiov_t* v, size_t doffs, size_t n)
+{
+    return copy_bits_to_iov_(src, soffs, v, doffs, n, 1);
+}
+
+static long inline get_bits_iov_le(bitiov_t* v, uint32_t* value,
+				   size_t i, size_t n)
+{
+    return get_bits_iov_(v, value, i, n, 0);
+}
+
+static long inline get_bits_iov_be(bitiov_t* v, uint32_t* value,
+				   size_t i, size_t n)
+{
+    return get_bits_iov_(v, value, i, n, 1);
+}
+
+static long inline set_bits_iov_le(bitiov_t* v, uint32_t value,
+				   size_t i, size_t n)
+{
+    return set_bits_iov_(v, value, i, n, 0);
+}
+
+static long inline set_bits_iov_be(bitiov_t* v, uint32_t value,
+				   size_t i, size_t n)
+{
+    return set_bits_iov_(v, value, i, n, 1);
+}
+
+//
+// sequential reader/writer on v->pos
+//
+static long inline read_bits_iov_le(bitiov_t* v, uint32_t* value, size_t n)
+{
+    long r = get_bits_iov_(v, value, v->pos, n, 0);
+    if (r >= 0) v->pos += n;
+    return r;
+}
+
+static long inline read_bits_iov_be(bitiov_t* v, uint32_t* value, size_t n)
+{
+    long r = get_bits_iov_(v, value, v->pos, n, 1);
+    if (r >= 0) v->pos += n;
+    return r;
+}
+
+static long inline write_bits_iov_le(bitiov_t* v, uint32_t value, size_t n)
+{
+    long r = set_bits_iov_(v, value, v->pos, n, 0);
+    if (r >= 0) v->pos += n;
+    return r;
+}
+
+static long inline write_bits_iov_be(bitiov_t* v, uint32_t value, size_t n)
+{
+    long r = set_bits_iov_(v, value, v->pos, n, 1);
+    if (r >= 0) v->pos += n;
+    return r;
+}
+
+#endif
@@ -0,0 +1,200 @@
+//
+// Single producer single consumer ring of bit packed records
+//
+// Records are stored back to back as a 32 bit length followed by the
+// record bits, each record starts on a byte boundary.
+// The producer reserves space, writes the record in place (seq_bits,
+// set_bits) and commits it, the consumer peeks a record, reads it in
+// place (get_bits) and consumes it. Positions are counted in bits and
+// only grow, the shared head and tail are published with release
+// stores on their own cache lines, publish and release may be called
+// once per batch of records.
+//
+// A record crossing the end of the ring is written contiguously into a
+// spill area after the end and copied to the start on commit with
+// copy_bits, so both sides always see a record as one contiguous bit
+// range. The spill area keeps that copy until the consumer is past the
+// record.
+//
+// The byte boundary keeps the producer from rewriting the last byte
+// of a record the consumer may be reading, at most 7 bits per record
+// are lost to it.
+//
+
+#ifndef __BITPACK_RING_H__
+#define __BITPACK_RING_H__
+
+#include <stdlib.h>
+#include "bitpack.h"
+
+#define BITRING_LINE  64
+#define BITRING_HDR   32     // length header bits
+#define BITRING_SLACK 64     // free bits kept ahead of the tail
+
+#define BITRING_BE    0x01   // big endian fill order
+#define BITRING_ALIGN 0x02   // always the case, kept for old callers
+
+typedef struct {
+    uint64_t pos;            // position in bits
+    uint64_t cache;          // last position seen of the other side
+    uint8_t  pad[BITRING_LINE - 16];
+} bitring_side_t;
+
+typedef struct {
+    uint8_t* ptr;            // record bits start at bit offs of ptr
+    int      offs;           // 0..7
+    size_t   n;              // record size in bits
+} bitring_rec_t;
+
+typedef struct {
+    uint8_t* ptr;            // size bytes followed by the spill area
+    size_t   size;           // ring size in bytes, power of 2
+    uint64_t mask;           // bit position mask
+    size_t   max_bits;       // max record size
+    int      flags;
+    bitring_side_t head __attribute__((aligned(BITRING_LINE)));  // published
+    bitring_side_t tail __attribute__((aligned(BITRING_LINE)));  // released
+    bitring_side_t prod __attribute__((aligned(BITRING_LINE)));  // pos, tail
+    bitring_side_t cons __attribute__((aligned(BITRING_LINE)));  // pos, head
+} bitring_t;
+
+static int inline bitring_init(bitring_t* r, size_t size, size_t max_bits,
+			       int flags)
+{
+    size_t spill = ((BITRING_HDR + max_bits + 7) >> 3) + 8;
+
+    if ((size == 0) || (size & (size - 1)) ||
+	(BITRING_HDR + max_bits + BITRING_SLACK + 7 > 8*size) ||
+	(max_bits > 0xffffffff))
+	return -1;
+    memset(r, 0, sizeof(bitring_t));
+    if (!(r->ptr = (uint8_t*) calloc(size + spill, 1)))
+	return -1;
+    r->size = size;
+    r->mask = 8*(uint64_t)size - 1;
+    r->max_bits = max_bits;
+    r->flags = flags;
+    return 0;
+}
+
+static void inline bitring_free(bitring_t* r)
+{
+    free(r->ptr);
+    r->ptr = NULL;
+}
+
+static void inline bitring_put_hdr_(bitring_t* r, uint64_t o, uint32_t n)
+{
+    uint8_t* p = r->ptr + (o >> 3);
+    if (r->flags & BITRING_BE) {
+	seq_bits_be(p, n >> 16, BIT_OFFSET(o), 16);
+	seq_bits_be(p, n & 0xffff, BIT_OFFSET(o) + 16, 16);
+    }
+    else {
+	seq_bits_le(p, n & 0xffff, BIT_OFFSET(o), 16);
+	seq_bits_le(p, n >> 16, BIT_OFFSET(o) + 16, 16);
+    }
+}
+
+static uint32_t inline bitring_get_hdr_(bitring_t* r, uint64_t o)
+{
+    const uint8_t* p = r->ptr + (o >> 3);
+    uint32_t lo = 0, hi = 0;
+    if (r->flags & BITRING_BE) {
+	get_bits_be(p, &hi, BIT_OFFSET(o), 16);
+	get_bits_be(p, &lo, BIT_OFFSET(o) + 16, 16);
+    }
+    else {
+	get_bits_le(p, &lo, BIT_OFFSET(o), 16);
+	get_bits_le(p, &hi, BIT_OFFSET(o) + 16, 16);
+    }
+    return (hi << 16) | lo;
+}
+
+static uint64_t inline bitring_next_(uint64_t pos, size_t n)
+{
+    pos += BITRING_HDR + n;
+    return (pos + 7) & ~(uint64_t) 7;
+}
+
+//
+// producer
+//
+
+// reserve n bits and write the header, -1 if the ring is full or n
+// is too large
+static int inline bitring_reserve(bitring_t* r, size_t n, bitring_rec_t* rec)
+{
+    uint64_t end, o;
+
+    if (n > r->max_bits)
+	return -1;
+    end = bitring_next_(r->prod.pos, n) + BITRING_SLACK;
+    if (end - r->prod.cache > 8*(uint64_t)r->size) {
+	r->prod.cache = __atomic_load_n(&r->tail.pos, __ATOMIC_ACQUIRE);
+	if (end - r->prod.cache > 8*(uint64_t)r->size)
+	    return -1;
+    }
+    o = r->prod.pos & r->mask;
+    bitring_put_hdr_(r, o, n);  // before the record bits, seq_bits clobbers right
+    o += BITRING_HDR;
+    rec->ptr = r->ptr + (o >> 3);
+    rec->offs = BIT_OFFSET(o);
+    rec->n = n;
+    return 0;
+}
+
+// commit the record last reserved, visible after bitring_publish
+static void inline bitring_commit(bitring_t* r, const bitring_rec_t* rec)
+{
+    uint64_t o = r->prod.pos & r->mask;
+    uint64_t e = o + BITRING_HDR + rec->n;
+
+    if (e > 8*(uint64_t)r->size) {  // wrapped part to the start
+	if (r->flags & BITRING_BE)
+	    copy_bits_be(r->ptr + r->size, 0, r->ptr, 0, e - 8*r->size);
+	else
+	    copy_bits_le(r->ptr + r->size, 0, r->ptr, 0, e - 8*r->size);
+    }
+    r->prod.pos = bitring_next_(r->prod.pos, rec->n);
+}
+
+static void inline bitring_publish(bitring_t* r)
+{
+    __atomic_store_n(&r->head.pos, r->prod.pos, __ATOMIC_RELEASE);
+}
+
+//
+// consumer
+//
+
+// next record, -1 if the ring is empty
+static int inline bitring_peek(bitring_t* r, bitring_rec_t* rec)
+{
+    uint64_t o;
+
+    if (r->cons.pos == r->cons.cache) {
+	r->cons.cache = __atomic_load_n(&r->head.pos, __ATOMIC_ACQUIRE);
+	if (r->cons.pos == r->cons.cache)
+	    return -1;
+    }
+    o = r->cons.pos & r->mask;
+    rec->n = bitring_get_hdr_(r, o);
+    o += BITRING_HDR;
+    rec->ptr = r->ptr + (o >> 3);
+    rec->offs = BIT_OFFSET(o);
+    return 0;
+}
+
+// done with the record last peeked, space returned by bitring_release
+static void inline bitring_consume(bitring_t* r, const bitring_rec_t* rec)
+{
+    r->cons.pos = bitring_next_(r->cons.pos, rec->n);
+}
+
+static void inline bitring_release(bitring_t* r)
+{
+    __atomic_store_n(&r->tail.pos, r->cons.pos, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,729 @@
+//
+// Compressed bitmaps (Roaring style)
+//
+// A bitmap of 32 bit positions is split into chunks of 65536 bits by
+// the high 16 bits. Each non empty chunk is stored in the smallest of
+// three containers:
+//   array   sorted 16 bit positions (at most 4096)
+//   run     (start, length-1) pairs of 16 bit values
+//   bitset  1024 64-bit words
+// Conversion from raw bitmaps (get_bit_le/be order) reads 64-bit words,
+// count and rank use the per container cardinality, and intersections
+// with an array container probe the other container instead of
+// expanding it. Arrays are merged as sorted lists, runs as intervals,
+// only operations with a bitset container work on 64-bit words.
+//
+
+#ifndef __BITPACK_ROAR_H__
+#define __BITPACK_ROAR_H__
+
+#include <stdlib.h>
+#include "bitpack.h"
+
+#define BITROAR_ARRAY     1
+#define BITROAR_BITSET    2
+#define BITROAR_RUN       3
+
+#define BITROAR_WORDS     1024      // 64-bit words in a chunk
+#define BITROAR_ARRAY_MAX 4096
+
+#define BITROAR_AND       0
+#define BITROAR_OR        1
+#define BITROAR_XOR       2
+#define BITROAR_ANDNOT    3
+
+typedef struct {
+    uint16_t key;     // high 16 bits of the positions
+    uint8_t  type;
+    uint32_t card;    // number of bits set
+    uint32_t n;       // array values or runs
+    void*    data;
+} bitroar_cont_t;
+
+typedef struct {
+    size_t          n;
+    size_t          cap;
+    bitroar_cont_t* c;
+} bitroar_t;
+
+static void inline bitroar_init(bitroar_t* r)
+{
+    r->n = 0;
+    r->cap = 0;
+    r->c = NULL;
+}
+
+static void inline bitroar_free(bitroar_t* r)
+{
+    size_t i;
+    for (i = 0; i < r->n; i++)
+	free(r->c[i].data);
+    free(r->c);
+    bitroar_init(r);
+}
+
+// memory used in bytes
+static size_t inline bitroar_size(const bitroar_t* r)
+{
+    size_t i, size = sizeof(bitroar_t) + r->n * sizeof(bitroar_cont_t);
+    for (i = 0; i < r->n; i++) {
+	switch(r->c[i].type) {
+	case BITROAR_ARRAY:  size += 2*r->c[i].n; break;
+	case BITROAR_RUN:    size += 4*r->c[i].n; break;
+	case BITROAR_BITSET: size += 8*BITROAR_WORDS; break;
+	}
+    }
+    return size;
+}
+
+// reverse the bits in each byte, big endian bitmap word to little endian
+static uint64_t inline bitroar_rev8_(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return x;
+}
+
+// next position >= i with bit value v, 65536 if none
+static uint32_t inline bitroar_next_(const uint64_t* w, uint32_t i, int v)
+{
+    while (i < 65536) {
+	uint64_t x = (v ? w[i >> 6] : ~w[i >> 6]) >> (i & 63);
+	if (x)
+	    return i + __builtin_ctzll(x);
+	i = (i | 63) + 1;
+    }
+    return 65536;
+}
+
+// set bits a..b (inclusive)
+static void inline bitroar_set_range_(uint64_t* w, uint32_t a, uint32_t b)
+{
+    uint32_t i = a >> 6, j = b >> 6;
+    uint64_t ma = ~(uint64_t) 0 << (a & 63);
+    uint64_t mb = ~(uint64_t) 0 >> (63 - (b & 63));
+    if (i == j)
+	w[i] |= ma & mb;
+    else {
+	w[i++] |= ma;
+	while (i < j)
+	    w[i++] = ~(uint64_t) 0;
+	w[j] |= mb;
+    }
+}
+
+static int inline bitroar_push_(bitroar_t* r, const bitroar_cont_t* c)
+{
+    if (r->n == r->cap) {
+	size_t cap = r->cap ? 2*r->cap : 8;
+	bitroar_cont_t* p = (bitroar_cont_t*)
+	    realloc(r->c, cap*sizeof(bitroar_cont_t));
+	if (!p)
+	    return -1;
+	r->c = p;
+	r->cap = cap;
+    }
+    r->c[r->n++] = *c;
+    return 0;
+}
+
+// runs are the smallest container for card bits in nruns runs
+static int inline bitroar_use_runs_(uint32_t card, uint32_t nruns)
+{
+    return (4*nruns < 8*BITROAR_WORDS) &&
+	((card > BITROAR_ARRAY_MAX) || (4*nruns < 2*card));
+}
+
+//
+// append the chunk in w (1024 words) with key as the smallest container,
+// nothing is added for an empty chunk
+//
+static int inline bitroar_pack_(bitroar_t* r, uint16_t key, const uint64_t* w)
+{
+    bitroar_cont_t c;
+    uint32_t card = 0, nruns = 0, i, k;
+    uint64_t prev = 0;
+
+    for (i = 0; i < BITROAR_WORDS; i++) {
+	card += __builtin_popcountll(w[i]);
+	nruns += __builtin_popcountll(w[i] & ~((w[i] << 1) | prev));
+	prev = w[i] >> 63;
+    }
+    if (card == 0)
+	return 0;
+    c.key = key;
+    c.card = card;
+    if (bitroar_use_runs_(card, nruns)) {
+	uint16_t* d = (uint16_t*) malloc(4*nruns);
+	uint32_t a = bitroar_next_(w, 0, 1);
+	if (!d)
+	    return -1;
+	for (k = 0; k < nruns; k++) {
+	    uint32_t b = bitroar_next_(w, a, 0);
+	    d[2*k] = a;
+	    d[2*k+1] = b - 1 - a;
+	    a = bitroar_next_(w, b, 1);
+	}
+	c.type = BITROAR_RUN;
+	c.n = nruns;
+	c.data = d;
+    }
+    else if (card <= BITROAR_ARRAY_MAX) {
+	uint16_t* d = (uint16_t*) malloc(2*card);
+	if (!d)
+	    return -1;
+	for (i = 0, k = 0; i < BITROAR_WORDS; i++) {
+	    uint64_t x = w[i];
+	    while (x) {
+		d[k++] = (i << 6) + __builtin_ctzll(x);
+		x &= x - 1;
+	    }
+	}
+	c.type = BITROAR_ARRAY;
+	c.n = card;
+	c.data = d;
+    }
+    else {
+	uint64_t* d = (uint64_t*) malloc(8*BITROAR_WORDS);
+	if (!d)
+	    return -1;
+	memcpy(d, w, 8*BITROAR_WORDS);
+	c.type = BITROAR_BITSET;
+	c.n = 0;
+	c.data = d;
+    }
+    if (bitroar_push_(r, &c) < 0) {
+	free(c.data);
+	return -1;
+    }
+    return 0;
+}
+
+// expand container to 1024 words
+static void inline bitroar_unpack_(const bitroar_cont_t* c, uint64_t* w)
+{
+    const uint16_t* d = (const uint16_t*) c->data;
+    uint32_t k;
+
+    if (c->type == BITROAR_BITSET) {
+	memcpy(w, c->data, 8*BITROAR_WORDS);
+	return;
+    }
+    memset(w, 0, 8*BITROAR_WORDS);
+    if (c->type == BITROAR_ARRAY) {
+	for (k = 0; k < c->n; k++)
+	    w[d[k] >> 6] |= (uint64_t) 1 << (d[k] & 63);
+    }
+    else {
+	for (k = 0; k < c->n; k++)
+	    bitroar_set_range_(w, d[2*k], d[2*k] + d[2*k+1]);
+    }
+}
+
+// number of runs starting at or before x
+static uint32_t inline bitroar_runs_upto_(const bitroar_cont_t* c, uint16_t x)
+{
+    const uint16_t* d = (const uint16_t*) c->data;
+    uint32_t lo = 0, hi = c->n;
+    while (lo < hi) {
+	uint32_t m = (lo + hi) >> 1;
+	if (d[2*m] <= x) lo = m + 1; else hi = m;
+    }
+    return lo;
+}
+
+// number of array values <= x
+static uint32_t inline bitroar_upper_(const bitroar_cont_t* c, uint16_t x)
+{
+    const uint16_t* d = (const uint16_t*) c->data;
+    uint32_t lo = 0, hi = c->n;
+    while (lo < hi) {
+	uint32_t m = (lo + hi) >> 1;
+	if (d[m] <= x) lo = m + 1; else hi = m;
+    }
+    return lo;
+}
+
+static int inline bitroar_cont_has_(const bitroar_cont_t* c, uint16_t x)
+{
+    const uint16_t* d = (const uint16_t*) c->data;
+    uint32_t k;
+
+    switch(c->type) {
+    case BITROAR_ARRAY:
+	k = bitroar_upper_(c, x);
+	return k && (d[k-1] == x);
+    case BITROAR_RUN:
+	k = bitroar_runs_upto_(c, x);
+	return k && (x - d[2*(k-1)] <= d[2*(k-1)+1]);
+    default:
+	return (((const uint64_t*) c->data)[x >> 6] >> (x & 63)) & 1;
+    }
+}
+
+// container index with key, or -1
+static long inline bitroar_find_(const bitroar_t* r, uint16_t key)
+{
+    size_t lo = 0, hi = r->n;
+    while (lo < hi) {
+	size_t m = (lo + hi) >> 1;
+	if (r->c[m].key < key) lo = m + 1; else hi = m;
+    }
+    return ((lo < r->n) && (r->c[lo].key == key)) ? (long) lo : -1;
+}
+
+//
+// conversion from and to raw bitmaps of nbits bits
+//
+static int inline bitroar_from_bits_(bitroar_t* r, const uint8_t* ptr,
+				     size_t nbits, int be)
+{
+    uint64_t* w = (uint64_t*) malloc(8*BITROAR_WORDS);
+    size_t nbytes = (nbits + 7) >> 3;
+    size_t chunk, i;
+
+    bitroar_free(r);
+    if (!w || (nbits > ((size_t) 1 << 32))) {
+	free(w);
+	return -1;
+    }
+    for (chunk = 0; (chunk << 16) < nbits; chunk++) {
+	const uint8_t* p = ptr + (chunk << 13);
+	for (i = 0; i < BITROAR_WORDS; i++) {
+	    size_t b = (chunk << 13) + 8*i;   // byte offset of word
+	    uint64_t x;
+	    if (b + 8 <= nbytes)
+		x = load_le64(p + 8*i);
+	    else if (b < nbytes) {
+		uint8_t tmp[8];
+		memset(tmp, 0, 8);
+		memcpy(tmp, p + 8*i, nbytes - b);
+		x = load_le64(tmp);
+	    }
+	    else
+		x = 0;
+	    if (be)
+		x = bitroar_rev8_(x);
+	    if (8*(b + 8) > nbits)  // drop bits past nbits
+		x &= (8*b >= nbits) ? 0 : MAKE_MASK64(nbits - 8*b);
+	    w[i] = x;
+	}
+	if (bitroar_pack_(r, chunk, w) < 0) {
+	    free(w);
+	    bitroar_free(r);
+	    return -1;
+	}
+    }
+    free(w);
+    return 0;
+}
+
+static int inline bitroar_from_bits_le(bitroar_t* r, const uint8_t* ptr,
+				       size_t nbits)
+{
+    return bitroar_from_bits_(r, ptr, nbits, 0);
+}
+
+static int inline bitroar_from_bits_be(bitroar_t* r, const uint8_t* ptr,
+				       size_t nbits)
+{
+    return bitroar_from_bits_(r, ptr, nbits, 1);
+}
+
+// write the bitmap as nbits raw bits, positions >= nbits are dropped
+static int inline bitroar_to_bits_(const bitroar_t* r, uint8_t* ptr,
+				   size_t nbits, int be)
+{
+    uint64_t* w = (uint64_t*) malloc(8*BITROAR_WORDS);
+    size_t nbytes = (nbits + 7) >> 3;
+    size_t k, i;
+
+    if (!w)
+	return -1;
+    memset(ptr, 0, nbytes);
+    for (k = 0; k < r->n; k++) {
+	size_t base = (size_t) r->c[k].key << 13;  // byte offset
+	if (base >= nbytes)
+	    break;
+	bitroar_unpack_(&r->c[k], w);
+	for (i = 0; i < BITROAR_WORDS; i++) {
+	    size_t b = base + 8*i;
+	    uint64_t x = w[i];
+	    if (b >= nbytes)
+		break;
+	    if (be)
+		x = bitroar_rev8_(x);
+	    if (b + 8 <= nbytes)
+		store_le64(ptr + b, x);
+	    else {
+		uint8_t tmp[8];
+		store_le64(tmp, x);
+		memcpy(ptr + b, tmp, nbytes - b);
+	    }
+	}
+    }
+    if (nbits & 7)  // clear bits past nbits in the last byte
+	ptr[nbytes-1] &= be ? (0xffu << (8 - (nbits & 7))) : MAKE_MASK(nbits & 7);
+    free(w);
+    return 0;
+}
+
+static int inline bitroar_to_bits_le(const bitroar_t* r, uint8_t* ptr,
+				     size_t nbits)
+{
+    return bitroar_to_bits_(r, ptr, nbits, 0);
+}
+
+static int inline bitroar_to_bits_be(const bitroar_t* r, uint8_t* ptr,
+				     size_t nbits)
+{
+    return bitroar_to_bits_(r, ptr, nbits, 1);
+}
+
+//
+// queries
+//
+static uint64_t inline bitroar_count(const bitroar_t* r)
+{
+    uint64_t n = 0;
+    size_t k;
+    for (k = 0; k < r->n; k++)
+	n += r->c[k].card;
+    return n;
+}
+
+static int inline bitroar_contains(const bitroar_t* r, uint32_t x)
+{
+    long k = bitroar_find_(r, x >> 16);
+    return (k >= 0) && bitroar_cont_has_(&r->c[k], x & 0xffff);
+}
+
+// number of positions <= x
+static uint64_t inline bitroar_rank(const bitroar_t* r, uint32_t x)
+{
+    uint16_t key = x >> 16, lo = x & 0xffff;
+    uint64_t n = 0;
+    size_t k;
+
+    for (k = 0; (k < r->n) && (r->c[k].key < key); k++)
+	n += r->c[k].card;
+    if ((k < r->n) && (r->c[k].key == key)) {
+	const bitroar_cont_t* c = &r->c[k];
+	const uint16_t* d = (const uint16_t*) c->data;
+	const uint64_t* w = (const uint64_t*) c->data;
+	uint32_t i, m;
+	switch(c->type) {
+	case BITROAR_ARRAY:
+	    n += bitroar_upper_(c, lo);
+	    break;
+	case BITROAR_RUN:
+	    m = bitroar_runs_upto_(c, lo);
+	    for (i = 0; i < m; i++) {
+		uint32_t last = d[2*i] + d[2*i+1];
+		n += ((last < lo) ? last : lo) - d[2*i] + 1;
+	    }
+	    break;
+	default:
+	    for (i = 0; i < (uint32_t) (lo >> 6); i++)
+		n += __builtin_popcountll(w[i]);
+	    n += __builtin_popcountll(w[i] & (~(uint64_t) 0 >> (63 - (lo & 63))));
+	    break;
+	}
+    }
+    return n;
+}
+
+//
+// set operations, dst = a op b, dst is replaced and must not be a or b
+//
+
+// a AND b with a an array container, probe b
+static int inline bitroar_and_array_(bitroar_t* dst, const bitroar_cont_t* a,
+				     const bitroar_cont_t* b)
+{
+    const uint16_t* d = (const uint16_t*) a->data;
+    uint16_t* e = (uint16_t*) malloc(2*a->n);
+    bitroar_cont_t c;
+    uint32_t k, n = 0;
+
+    if (!e)
+	return -1;
+    for (k = 0; k < a->n; k++) {
+	if (bitroar_cont_has_(b, d[k]))
+	    e[n++] = d[k];
+    }
+    if (n == 0) {
+	free(e);
+	return 0;
+    }
+    c.key = a->key;
+    c.type = BITROAR_ARRAY;
+    c.card = n;
+    c.n = n;
+    c.data = e;
+    if (bitroar_push_(dst, &c) < 0) {
+	free(e);
+	return -1;
+    }
+    return 0;
+}
+
+// append a copy of container c
+static int inline bitroar_copy_(bitroar_t* dst, const bitroar_cont_t* c)
+{
+    size_t size = (c->type == BITROAR_ARRAY) ? 2*c->n :
+	(c->type == BITROAR_RUN) ? 4*c->n : 8*BITROAR_WORDS;
+    bitroar_cont_t e = *c;
+
+    e.data = malloc(size);
+    if (!e.data)
+	return -1;
+    memcpy(e.data, c->data, size);
+    if (bitroar_push_(dst, &e) < 0) {
+	free(e.data);
+	return -1;
+    }
+    return 0;
+}
+
+// next run edge of an array or run container, start of run k or
+// one past its end when inside, 65536 after the last run
+static uint32_t inline bitroar_edge_(const bitroar_cont_t* c, uint32_t k,
+				     int inside)
+{
+    const uint16_t* d = (const uint16_t*) c->data;
+    if (k >= c->n)
+	return 65536;
+    if (c->type == BITROAR_ARRAY)
+	return d[k] + inside;
+    return inside ? d[2*k] + d[2*k+1] + 1 : d[2*k];
+}
+
+//
+// append n runs e (start, length-1) with card bits as the smallest
+// container, like bitroar_pack_, e is taken over
+//
+static int inline bitroar_push_runs_(bitroar_t* dst, uint16_t key,
+				     uint16_t* e, uint32_t n, uint32_t card)
+{
+    bitroar_cont_t c;
+    uint32_t k, x;
+
+    if (card == 0) {
+	free(e);
+	return 0;
+    }
+    c.key = key;
+    c.card = card;
+    if (bitroar_use_runs_(card, n)) {
+	c.type = BITROAR_RUN;
+	c.n = n;
+	c.data = e;
+    }
+    else if (card <= BITROAR_ARRAY_MAX) {
+	uint16_t* d = (uint16_t*) malloc(2*card);
+	uint32_t i = 0;
+	if (!d) {
+	    free(e);
+	    return -1;
+	}
+	for (k = 0; k < n; k++) {
+	    for (x = e[2*k]; x <= (uint32_t) e[2*k] + e[2*k+1]; x++)
+		d[i++] = x;
+	}
+	free(e);
+	c.type = BITROAR_ARRAY;
+	c.n = card;
+	c.data = d;
+    }
+    else {
+	uint64_t* w = (uint64_t*) calloc(BITROAR_WORDS, 8);
+	if (!w) {
+	    free(e);
+	    return -1;
+	}
+	for (k = 0; k < n; k++)
+	    bitroar_set_range_(w, e[2*k], e[2*k] + e[2*k+1]);
+	free(e);
+	c.type = BITROAR_BITSET;
+	c.n = 0;
+	c.data = w;
+    }
+    if (bitroar_push_(dst, &c) < 0) {
+	free(c.data);
+	return -1;
+    }
+    return 0;
+}
+
+static int inline bitroar_opbit_(int op, int x, int y)
+{
+    switch(op) {
+    case BITROAR_AND:    return x & y;
+    case BITROAR_OR:     return x | y;
+    case BITROAR_XOR:    return x ^ y;
+    default:             return x & !y;
+    }
+}
+
+//
+// a op b for array and run containers, arrays are runs of length 1.
+// Walk the run edges of both and emit the runs where op holds
+//
+static int inline bitroar_merge_(bitroar_t* dst, const bitroar_cont_t* a,
+				 const bitroar_cont_t* b, int op)
+{
+    uint16_t* e = (uint16_t*) malloc(4*(a->n + b->n) + 4);
+    uint32_t ia = 0, ib = 0, n = 0, card = 0, start = 0, x;
+    uint32_t xa = bitroar_edge_(a, 0, 0), xb = bitroar_edge_(b, 0, 0);
+    int ina = 0, inb = 0, in = 0, v;
+
+    if (!e)
+	return -1;
+    while ((x = (xa < xb) ? xa : xb) < 65536) {
+	// an array value next to the previous one starts where it ends
+	while (xa == x) {
+	    ia += ina;
+	    ina = !ina;
+	    xa = bitroar_edge_(a, ia, ina);
+	}
+	while (xb == x) {
+	    ib += inb;
+	    inb = !inb;
+	    xb = bitroar_edge_(b, ib, inb);
+	}
+	v = bitroar_opbit_(op, ina, inb);
+	if (v && !in)
+	    start = x;
+	else if (!v && in) {
+	    e[2*n] = start;
+	    e[2*n+1] = x - 1 - start;
+	    card += x - start;
+	    n++;
+	}
+	in = v;
+    }
+    if (in) {  // run up to the end of the chunk
+	e[2*n] = start;
+	e[2*n+1] = 65535 - start;
+	card += 65536 - start;
+	n++;
+    }
+    return bitroar_push_runs_(dst, a->key, e, n, card);
+}
+
+// a op b for two array containers, merge the sorted values into runs
+static int inline bitroar_merge_array_(bitroar_t* dst, const bitroar_cont_t* a,
+				       const bitroar_cont_t* b, int op)
+{
+    const uint16_t* da = (const uint16_t*) a->data;
+    const uint16_t* db = (const uint16_t*) b->data;
+    uint16_t* e = (uint16_t*) malloc(4*(a->n + b->n) + 4);
+    uint32_t i = 0, j = 0, n = 0, card = 0, x;
+    int ina, inb;
+
+    if (!e)
+	return -1;
+    while ((i < a->n) || (j < b->n)) {
+	ina = (i < a->n) && ((j == b->n) || (da[i] <= db[j]));
+	inb = (j < b->n) && ((i == a->n) || (db[j] <= da[i]));
+	x = ina ? da[i] : db[j];
+	i += ina;
+	j += inb;
+	if (!bitroar_opbit_(op, ina, inb))
+	    continue;
+	if (n && ((uint32_t) e[2*n-2] + e[2*n-1] + 1 == x))
+	    e[2*n-1]++;
+	else {
+	    e[2*n] = x;
+	    e[2*n+1] = 0;
+	    n++;
+	}
+	card++;
+    }
+    return bitroar_push_runs_(dst, a->key, e, n, card);
+}
+
+static int inline bitroar_op_(bitroar_t* dst, const bitroar_t* a,
+			      const bitroar_t* b, int op)
+{
+    uint64_t* wa = (uint64_t*) malloc(16*BITROAR_WORDS);
+    uint64_t* wb = wa + BITROAR_WORDS;
+    size_t i = 0, j = 0, k;
+    int res = 0;
+
+    bitroar_free(dst);
+    if (!wa)
+	return -1;
+    while ((res == 0) && ((i < a->n) || (j < b->n))) {
+	const bitroar_cont_t* ca = (i < a->n) ? &a->c[i] : NULL;
+	const bitroar_cont_t* cb = (j < b->n) ? &b->c[j] : NULL;
+	if (ca && cb && (ca->key == cb->key)) {
+	    if ((ca->type == BITROAR_ARRAY) && (cb->type == BITROAR_ARRAY))
+		res = bitroar_merge_array_(dst, ca, cb, op);
+	    else if ((op == BITROAR_AND) && (ca->type == BITROAR_ARRAY))
+		res = bitroar_and_array_(dst, ca, cb);
+	    else if ((op == BITROAR_AND) && (cb->type == BITROAR_ARRAY))
+		res = bitroar_and_array_(dst, cb, ca);
+	    else if ((ca->type != BITROAR_BITSET) &&
+		     (cb->type != BITROAR_BITSET))
+		res = bitroar_merge_(dst, ca, cb, op);
+	    else {
+		bitroar_unpack_(ca, wa);
+		bitroar_unpack_(cb, wb);
+		for (k = 0; k < BITROAR_WORDS; k++) {
+		    switch(op) {
+		    case BITROAR_AND:    wa[k] &= wb[k]; break;
+		    case BITROAR_OR:     wa[k] |= wb[k]; break;
+		    case BITROAR_XOR:    wa[k] ^= wb[k]; break;
+		    case BITROAR_ANDNOT: wa[k] &= ~wb[k]; break;
+		    }
+		}
+		res = bitroar_pack_(dst, ca->key, wa);
+	    }
+	    i++;
+	    j++;
+	}
+	else if (ca && (!cb || (ca->key < cb->key))) {  // only in a
+	    if (op != BITROAR_AND)
+		res = bitroar_copy_(dst, ca);
+	    i++;
+	}
+	else {  // only in b
+	    if ((op == BITROAR_OR) || (op == BITROAR_XOR))
+		res = bitroar_copy_(dst, cb);
+	    j++;
+	}
+    }
+    free(wa);
+    if (res < 0)
+	bitroar_free(dst);
+    return res;
+}
+
+static int inline bitroar_and(bitroar_t* dst, const bitroar_t* a,
+			      const bitroar_t* b)
+{
+    return bitroar_op_(dst, a, b, BITROAR_AND);
+}
+
+static int inline bitroar_or(bitroar_t* dst, const bitroar_t* a,
+			     const bitroar_t* b)
+{
+    return bitroar_op_(dst, a, b, BITROAR_OR);
+}
+
+static int inline bitroar_xor(bitroar_t* dst, const bitroar_t* a,
+			      const bitroar_t* b)
+{
+    return bitroar_op_(dst, a, b, BITROAR_XOR);
+}
+
+static int inline bitroar_andnot(bitroar_t* dst, const bitroar_t* a,
+				 const bitroar_t* b)
+{
+    return bitroar_op_(dst, a, b, BITROAR_ANDNOT);
+}
+
+#endif
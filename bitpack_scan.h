@@ -0,0 +1,286 @@
+//
+// Predicate scans on packed fixed width columns
+//
+// A column holds n unsigned values of w bits back to back from bit 0
+// (as written by set_bits_le/seq_bits_le or the _be versions). A scan
+// evaluates lo <= x <= hi for every value and writes a selection bitmap
+// with bit i set for value i, in the same fill order as the column.
+// Bits past n in the last bitmap byte are cleared.
+//
+// For w <= 16 a 64-bit window holds k = 57/w values, all lanes are
+// compared at once with SWAR arithmetic and the per lane result bits
+// are collected with pext (BMI2) or a loop over the matches. With AVX2
+// wider values are gathered four at a time into 64-bit lanes, shifted
+// into place and compared in registers. Values close to the end of the
+// column, where a 64-bit load would read past it, use get_bits.
+//
+
+#ifndef __BITPACK_SCAN_H__
+#define __BITPACK_SCAN_H__
+
+#include "bitpack.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// bitmap output, k result bits at a time, first result in bit 0 (le)
+// or in the top bit of the k (be)
+typedef struct {
+    uint8_t* ptr;
+    uint64_t acc;
+    int      pos;      // bits in acc
+    int      be;
+} scan_out_t;
+
+static void inline scan_put_(scan_out_t* o, uint64_t r, int k)
+{
+    if (!o->be) {
+	o->acc |= r << o->pos;
+	if (o->pos + k >= 64) {
+	    store_le64(o->ptr, o->acc);
+	    o->ptr += 8;
+	    o->acc = o->pos ? (r >> (64 - o->pos)) : 0;
+	    o->pos += k - 64;
+	}
+	else
+	    o->pos += k;
+    }
+    else {
+	int s = 64 - o->pos - k;
+	if (s > 0) {
+	    o->acc |= r << s;
+	    o->pos += k;
+	}
+	else {
+	    o->acc |= r >> -s;
+	    store_be64(o->ptr, o->acc);
+	    o->ptr += 8;
+	    o->acc = s ? (r << (64 + s)) : 0;
+	    o->pos = -s;
+	}
+    }
+}
+
+static void inline scan_flush_(scan_out_t* o)
+{
+    int i;
+    for (i = 0; i < o->pos; i += 8) {
+	if (o->be)
+	    *o->ptr++ = o->acc >> (56 - i);
+	else
+	    *o->ptr++ = o->acc >> i;
+    }
+}
+
+// lanes of x less than lanes of y, result in the lane high bit,
+// x and y may only have bits inside the lanes, h is the high bit mask
+static uint64_t inline scan_lt_(uint64_t x, uint64_t y, uint64_t h)
+{
+    uint64_t t = (x | h) - (y & ~h);  // lane high bit set if low x >= low y
+    return ((~x & y) | (~(x ^ y) & ~t)) & h;
+}
+
+// collect the k lane bits of m (at h) into k consecutive bits
+static uint64_t inline scan_collect_(uint64_t m, uint64_t h, int w, int k,
+				     int be)
+{
+#ifdef __BMI2__
+    (void) w; (void) k; (void) be;
+    return _pext_u64(m, h);
+#else
+    uint64_t r = 0;
+    (void) h;
+    while (m) {
+	int b = __builtin_ctzll(m);
+	if (be)
+	    r |= (uint64_t) 1 << (k - 1 - (63 - b) / w);
+	else
+	    r |= (uint64_t) 1 << (b / w);
+	m &= m - 1;
+    }
+    return r;
+#endif
+}
+
+static size_t inline scan_swar_(const uint8_t* src, size_t n, int w,
+				uint32_t lo, uint32_t hi, int inv,
+				scan_out_t* o)
+{
+    size_t nbytes = (n * w + 7) >> 3;
+    int k = 57 / w;
+    uint64_t ones = 0, a, h, vlo, vhi, rmask = MAKE_MASK64(k);
+    size_t i = 0;
+    int j;
+
+    for (j = 0; j < k; j++)
+	ones |= (uint64_t) 1 << (j * w);
+    a = MAKE_MASK64(k * w);
+    if (o->be) {
+	ones <<= (64 - k * w);
+	a <<= (64 - k * w);
+    }
+    h = ones << (w - 1);
+    vlo = lo * ones;
+    vhi = hi * ones;
+    while ((i + k <= n) && (((i * w) >> 3) + 8 <= nbytes)) {
+	size_t offs = i * w;
+	uint64_t x, m;
+	if (o->be)
+	    x = load_be64(src + (offs >> 3)) << BIT_OFFSET(offs);
+	else
+	    x = load_le64(src + (offs >> 3)) >> BIT_OFFSET(offs);
+	x &= a;
+	m = ~(scan_lt_(x, vlo, h) | scan_lt_(vhi, x, h)) & h;
+	m = scan_collect_(m, h, w, k, o->be);
+	if (inv)
+	    m = ~m & rmask;
+	scan_put_(o, m, k);
+	i += k;
+    }
+    return i;
+}
+
+#ifdef __AVX2__
+static size_t inline scan_avx2_(const uint8_t* src, size_t n, int w,
+				uint32_t lo, uint32_t hi, int inv,
+				scan_out_t* o)
+{
+    size_t nbytes = (n * w + 7) >> 3;
+    const __m256i bswap = _mm256_setr_epi8(7,6,5,4,3,2,1,0,
+					   15,14,13,12,11,10,9,8,
+					   7,6,5,4,3,2,1,0,
+					   15,14,13,12,11,10,9,8);
+    __m256i bits = _mm256_setr_epi64x(0, w, 2*w, 3*w);
+    __m256i step = _mm256_set1_epi64x(4*w);
+    __m256i seven = _mm256_set1_epi64x(7);
+    __m256i mask = _mm256_set1_epi64x(MAKE_MASK64(w));
+    __m256i vlo = _mm256_set1_epi64x(lo);
+    __m256i vhi = _mm256_set1_epi64x(hi);
+    __m128i rs = _mm_cvtsi32_si128(64 - w);
+    size_t i = 0;
+
+    // the last of the four loads must stay inside the column
+    while ((i + 4 <= n) && ((((i + 3) * w) >> 3) + 8 <= nbytes)) {
+	__m256i byte = _mm256_srli_epi64(bits, 3);
+	__m256i sh = _mm256_and_si256(bits, seven);
+	__m256i x = _mm256_i64gather_epi64((const long long*) src, byte, 1);
+	__m256i out;
+	int m;
+	if (o->be) {
+	    x = _mm256_shuffle_epi8(x, bswap);
+	    x = _mm256_srl_epi64(_mm256_sllv_epi64(x, sh), rs);
+	}
+	else
+	    x = _mm256_and_si256(_mm256_srlv_epi64(x, sh), mask);
+	// values are below 2^32 so signed compare is fine
+	out = _mm256_or_si256(_mm256_cmpgt_epi64(vlo, x),
+			      _mm256_cmpgt_epi64(x, vhi));
+	m = ~_mm256_movemask_pd(_mm256_castsi256_pd(out)) & 0xf;
+	if (inv)
+	    m = ~m & 0xf;
+	if (o->be)  // first value to the top bit
+	    m = ((m & 1) << 3) | ((m & 2) << 1) | ((m & 4) >> 1) | ((m & 8) >> 3);
+	scan_put_(o, m, 4);
+	bits = _mm256_add_epi64(bits, step);
+	i += 4;
+    }
+    return i;
+}
+#endif
+
+static int inline scan_range_(const uint8_t* src, size_t n, int w,
+			      uint32_t lo, uint32_t hi, int inv,
+			      uint8_t* bitmap, int be)
+{
+    scan_out_t o;
+    uint32_t vmax;
+    size_t i;
+
+    if ((w <= 0) || (w > 32))
+	return -1;
+    vmax = (uint32_t) MAKE_MASK64(w);
+    if (hi > vmax)
+	hi = vmax;
+    o.ptr = bitmap;
+    o.acc = 0;
+    o.pos = 0;
+    o.be = be;
+    if (lo > hi) {  // empty range
+	size_t nb = n >> 3;
+	memset(bitmap, inv ? 0xff : 0, nb);
+	if (n & 7) {
+	    uint8_t m = be ? (0xff << (8 - (n & 7))) : (0xff >> (8 - (n & 7)));
+	    bitmap[nb] = inv ? m : 0;
+	}
+	return 0;
+    }
+    if (w <= 16)
+	i = scan_swar_(src, n, w, lo, hi, inv, &o);
+#ifdef __AVX2__
+    else
+	i = scan_avx2_(src, n, w, lo, hi, inv, &o);
+#else
+    else
+	i = 0;
+#endif
+    for (; i < n; i++) {
+	uint32_t x = 0;
+	if (be)
+	    get_bits_be(src, &x, i * w, w);
+	else
+	    get_bits_le(src, &x, i * w, w);
+	scan_put_(&o, ((x >= lo) && (x <= hi)) ^ inv, 1);
+    }
+    scan_flush_(&o);
+    return 0;
+}
+
+// select lo <= x <= hi
+static int inline scan_range_le(const uint8_t* src, size_t n, int w,
+				uint32_t lo, uint32_t hi, uint8_t* bitmap)
+{
+    return scan_range_(src, n, w, lo, hi, 0, bitmap, 0);
+}
+
+static int inline scan_range_be(const uint8_t* src, size_t n, int w,
+				uint32_t lo, uint32_t hi, uint8_t* bitmap)
+{
+    return scan_range_(src, n, w, lo, hi, 0, bitmap, 1);
+}
+
+// select x op c, op is BITPACK_EQ .. BITPACK_GE
+static int inline scan_bits_(const uint8_t* src, size_t n, int w,
+			     int op, uint32_t c, uint8_t* bitmap, int be)
+{
+    uint32_t vmax = (uint32_t) MAKE_MASK64((w > 0 && w <= 32) ? w : 32);
+    uint32_t lo = 0, hi = vmax;
+    int inv = 0;
+
+    switch(op) {
+    case BITPACK_EQ: lo = c; hi = c; break;
+    case BITPACK_NE: lo = c; hi = c; inv = 1; break;
+    case BITPACK_LT: if (c == 0) lo = 1, hi = 0; else hi = c - 1; break;
+    case BITPACK_LE: hi = c; break;
+    case BITPACK_GT: if (c >= vmax) lo = 1, hi = 0; else lo = c + 1; break;
+    case BITPACK_GE: lo = c; break;
+    default: return -1;
+    }
+    if (lo > vmax)  // constant out of range
+	lo = 1, hi = 0;
+    return scan_range_(src, n, w, lo, hi, inv, bitmap, be);
+}
+
+static int inline scan_bits_le(const uint8_t* src, size_t n, int w,
+			       int op, uint32_t c, uint8_t* bitmap)
+{
+    return scan_bits_(src, n, w, op, c, bitmap, 0);
+}
+
+static int inline scan_bits_be(const uint8_t* src, size_t n, int w,
+			       int op, uint32_t c, uint8_t* bitmap)
+{
+    return scan_bits_(src, n, w, op, c, bitmap, 1);
+}
+
+#endif
@@ -0,0 +1,230 @@
+//
+// Dirty range tracking for bitpack buffers
+//
+// Writes through the track_* setters mark the modified 64 byte chunks
+// in a bitmap (one bit per chunk). emit_delta produce a patch of the
+// changed chunks that apply_delta write into a copy of the buffer.
+//
+// Delta format, a sequence of runs:
+//   uint32 LE  first chunk
+//   uint32 LE  number of chunks
+//   chunk data (the last chunk in the buffer may be short)
+//
+
+#ifndef __BITPACK_TRACK_H__
+#define __BITPACK_TRACK_H__
+
+#include "bitpack.h"
+
+#define BITTRACK_SHIFT 6
+#define BITTRACK_CHUNK (1 << BITTRACK_SHIFT)   // bytes per dirty bit
+
+typedef struct {
+    uint8_t*  ptr;      // tracked buffer
+    size_t    size;     // buffer size in bytes
+    size_t    nchunks;  // number of chunks
+    uint64_t* dirty;    // one bit per chunk
+} bittrack_t;
+
+static int inline bittrack_init(bittrack_t* t, uint8_t* ptr, size_t size)
+{
+    t->ptr = ptr;
+    t->size = size;
+    t->nchunks = (size + BITTRACK_CHUNK - 1) >> BITTRACK_SHIFT;
+    t->dirty = (uint64_t*) calloc((t->nchunks + 63) >> 6, sizeof(uint64_t));
+    return t->dirty ? 0 : -1;
+}
+
+static void inline bittrack_free(bittrack_t* t)
+{
+    free(t->dirty);
+    t->dirty = NULL;
+}
+
+static void inline bittrack_clear(bittrack_t* t)
+{
+    memset(t->dirty, 0, ((t->nchunks + 63) >> 6) * sizeof(uint64_t));
+}
+
+// mark the chunks covering bits i .. i+n-1
+static void inline bittrack_mark(bittrack_t* t, size_t i, size_t n)
+{
+    size_t c, c1;
+
+    if (n == 0)
+	return;
+    c  = (i >> 3) >> BITTRACK_SHIFT;
+    c1 = ((i + n - 1) >> 3) >> BITTRACK_SHIFT;
+    for (; c <= c1; c++)
+	t->dirty[c >> 6] |= ((uint64_t) 1 << (c & 63));
+}
+
+static int inline bittrack_is_dirty(const bittrack_t* t, size_t c)
+{
+    return (t->dirty[c >> 6] >> (c & 63)) & 1;
+}
+
+//
+// tracked versions of the setters
+//
+static int inline track_set_bits_le(bittrack_t* t, uint32_t value,
+				    int i, size_t n)
+{
+    bittrack_mark(t, i, n);
+    return set_bits_le(t->ptr, value, i, n);
+}
+
+static int inline track_seq_bits_le(bittrack_t* t, uint32_t value,
+				    int i, size_t n)
+{
+    // seq_bits may overwrite the rest of the last byte
+    bittrack_mark(t, i, n + ((8 - BIT_OFFSET(i+n)) & 7));
+    return seq_bits_le(t->ptr, value, i, n);
+}
+
+static int inline track_clr_bits_le(bittrack_t* t, int i, size_t n)
+{
+    bittrack_mark(t, i, n);
+    return clr_bits_le(t->ptr, i, n);
+}
+
+static void inline track_set_bit_le(bittrack_t* t, int val, int i)
+{
+    bittrack_mark(t, i, 1);
+    set_bit_le(t->ptr, val, i);
+}
+
+static int inline track_copy_bits_le(uint8_t* src, uint32_t soffs,
+				     bittrack_t* t, uint32_t doffs,
+				     size_t n)
+{
+    bittrack_mark(t, doffs, n);
+    return copy_bits_le(src, soffs, t->ptr, doffs, n);
+}
+
+static int inline track_set_bits_be(bittrack_t* t, uint32_t value,
+				    int i, size_t n)
+{
+    bittrack_mark(t, i, n);
+    return set_bits_be(t->ptr, value, i, n);
+}
+
+static int inline track_seq_bits_be(bittrack_t* t, uint32_t value,
+				    int i, size_t n)
+{
+    bittrack_mark(t, i, n + ((8 - BIT_OFFSET(i+n)) & 7));
+    return seq_bits_be(t->ptr, value, i, n);
+}
+
+static int inline track_clr_bits_be(bittrack_t* t, int i, size_t n)
+{
+    bittrack_mark(t, i, n);
+    return clr_bits_be(t->ptr, i, n);
+}
+
+static void inline track_set_bit_be(bittrack_t* t, int val, int i)
+{
+    bittrack_mark(t, i, 1);
+    set_bit_be(t->ptr, val, i);
+}
+
+static int inline track_copy_bits_be(uint8_t* src, uint32_t soffs,
+				     bittrack_t* t, uint32_t doffs,
+				     size_t n)
+{
+    bittrack_mark(t, doffs, n);
+    return copy_bits_be(src, soffs, t->ptr, doffs, n);
+}
+
+// find the next run of dirty chunks starting at or after c
+static size_t inline bittrack_next_run_(const bittrack_t* t, size_t c,
+					size_t* len)
+{
+    size_t e;
+
+    while ((c < t->nchunks) && !bittrack_is_dirty(t, c)) {
+	uint64_t w = t->dirty[c >> 6] >> (c & 63);
+	if (w)
+	    c += __builtin_ctzll(w);
+	else
+	    c = (c | 63) + 1;
+    }
+    if (c >= t->nchunks) {
+	*len = 0;
+	return t->nchunks;
+    }
+    e = c + 1;
+    while ((e < t->nchunks) && bittrack_is_dirty(t, e)) {
+	uint64_t w = ~t->dirty[e >> 6] >> (e & 63);
+	if (w)
+	    e += __builtin_ctzll(w);
+	else
+	    e = (e | 63) + 1;
+    }
+    if (e > t->nchunks)
+	e = t->nchunks;
+    *len = e - c;
+    return c;
+}
+
+//
+// write the delta of dirty chunks to out, return the number of bytes
+// in the delta or -1 if out is too small. With out == NULL only the
+// size is calculated.
+//
+static long inline emit_delta(const bittrack_t* t, uint8_t* out,
+			      size_t outsize)
+{
+    size_t pos = 0;
+    size_t c = 0;
+    size_t len;
+
+    while ((c = bittrack_next_run_(t, c, &len)) < t->nchunks) {
+	size_t offs = c << BITTRACK_SHIFT;
+	size_t n = len << BITTRACK_SHIFT;
+	if (offs + n > t->size)
+	    n = t->size - offs;
+	if (out) {
+	    if (pos + 8 + n > outsize)
+		return -1;
+	    store_le32(out + pos, c);
+	    store_le32(out + pos + 4, len);
+	    memcpy(out + pos + 8, t->ptr + offs, n);
+	}
+	pos += 8 + n;
+	c += len;
+    }
+    return pos;
+}
+
+//
+// apply a delta produced by emit_delta to a buffer of size bytes,
+// return 0 on success and -1 if the delta is malformed
+//
+static int inline apply_delta(uint8_t* ptr, size_t size,
+			      const uint8_t* delta, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+	uint32_t c, nc;
+	size_t offs, n;
+	if (pos + 8 > len)
+	    return -1;
+	c = load_le32(delta + pos);
+	nc = load_le32(delta + pos + 4);
+	offs = (size_t) c << BITTRACK_SHIFT;
+	n = (size_t) nc << BITTRACK_SHIFT;
+	if ((offs >= size) || (n == 0) || (n > size - offs + BITTRACK_CHUNK-1))
+	    return -1;
+	if (offs + n > size)
+	    n = size - offs;
+	if (pos + 8 + n > len)
+	    return -1;
+	memcpy(ptr + offs, delta + pos + 8, n);
+	pos += 8 + n;
+    }
+    return 0;
+}
+
+#endif
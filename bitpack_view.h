@@ -0,0 +1,243 @@
+//
+// Lazy message views with on demand field decoding
+//
+// A layout (bitcol_layout_t, stride = message size in bits) is compiled
+// into byte offsets, shifts and masks once. A view wraps a message
+// pointer and decode a field only when it is read, optionally caching
+// the value. Predicates compare a field against a constant directly on
+// the packed bits: equality is a masked compare of the raw 64-bit word
+// against the constant pre-packed in memory order, ordered compares
+// mask the word in fill order without shifting the field down.
+//
+
+#ifndef __BITPACK_VIEW_H__
+#define __BITPACK_VIEW_H__
+
+#include "bitpack.h"
+#include "bitpack_column.h"
+
+typedef struct {
+    uint32_t offset;   // bit offset in message
+    uint32_t byte;     // byte holding the first bit
+    uint8_t  shift;    // shift of the value in the word at byte
+    uint8_t  width;
+    uint8_t  sign;
+    uint8_t  fast;     // 64-bit word at byte is inside the message
+} bitview_field_t;
+
+typedef struct {
+    int              be;
+    size_t           size;     // message size in bytes
+    int              nfields;
+    bitview_field_t* field;
+} bitview_layout_t;
+
+static int inline bitview_compile(bitview_layout_t* c,
+				  const bitcol_layout_t* l)
+{
+    int k;
+
+    if (!bitcol_check_(l))
+	return -1;
+    c->be = l->be;
+    c->size = (l->stride + 7) >> 3;
+    c->nfields = l->nfields;
+    c->field = (bitview_field_t*) malloc(l->nfields*sizeof(bitview_field_t));
+    if (!c->field)
+	return -1;
+    for (k = 0; k < l->nfields; k++) {
+	const bitcol_field_t* f = &l->field[k];
+	bitview_field_t* g = &c->field[k];
+	g->offset = f->offset;
+	g->byte = f->offset >> 3;
+	g->width = f->width;
+	g->sign = f->sign;
+	g->shift = l->be ? (64 - BIT_OFFSET(f->offset) - f->width)
+	    : BIT_OFFSET(f->offset);
+	g->fast = (g->byte + 8 <= c->size);
+    }
+    return 0;
+}
+
+static void inline bitview_free(bitview_layout_t* c)
+{
+    free(c->field);
+    c->field = NULL;
+}
+
+// decode field k of the message at ptr
+static uint32_t inline bitview_decode(const bitview_layout_t* c,
+				      const uint8_t* ptr, int k)
+{
+    const bitview_field_t* g = &c->field[k];
+    uint32_t v = 0;
+
+    if (g->fast) {
+	uint64_t w = c->be ? load_be64(ptr + g->byte) : load_le64(ptr + g->byte);
+	v = (w >> g->shift) & MAKE_MASK64(g->width);
+    }
+    else if (c->be)
+	get_bits_be(ptr, &v, g->offset, g->width);
+    else
+	get_bits_le(ptr, &v, g->offset, g->width);
+    if (g->sign)
+	v = bitcol_sign_(v, g->width);
+    return v;
+}
+
+//
+// view, the cache is optional (NULL or nfields entries), values of
+// the first 64 fields are cached
+//
+typedef struct {
+    const bitview_layout_t* layout;
+    const uint8_t*          ptr;
+    uint32_t*               cache;
+    uint64_t                valid;    // cached fields
+} bitview_t;
+
+static void inline bitview_init(bitview_t* v, const bitview_layout_t* c,
+				const uint8_t* ptr, uint32_t* cache)
+{
+    v->layout = c;
+    v->ptr = ptr;
+    v->cache = cache;
+    v->valid = 0;
+}
+
+// point the view at the next message, drops the cache
+static void inline bitview_reset(bitview_t* v, const uint8_t* ptr)
+{
+    v->ptr = ptr;
+    v->valid = 0;
+}
+
+static uint32_t inline bitview_get(bitview_t* v, int k)
+{
+    uint32_t x;
+
+    if (v->cache && (k < 64)) {
+	if ((v->valid >> k) & 1)
+	    return v->cache[k];
+	x = bitview_decode(v->layout, v->ptr, k);
+	v->cache[k] = x;
+	v->valid |= ((uint64_t) 1 << k);
+	return x;
+    }
+    return bitview_decode(v->layout, v->ptr, k);
+}
+
+//
+// predicates, field op constant, op is BITPACK_EQ .. BITPACK_GE
+//
+typedef struct {
+    int      field;
+    int      op;
+    uint32_t value;    // constant (for the slow path)
+    uint32_t byte;
+    int      fast;
+    uint64_t nmask;    // field mask in memory order (raw load)
+    uint64_t nvalue;   // constant packed in memory order
+    uint64_t omask;    // field mask in fill order word
+    uint64_t ovalue;   // constant in fill order word, sign flipped
+    uint64_t oflip;    // sign bit in fill order word
+    int      always;   // result when the constant is out of range, else -1
+} bitview_pred_t;
+
+static int inline bitview_cmp_(int op, int c)
+{
+    switch(op) {
+    case BITPACK_EQ: return c == 0;
+    case BITPACK_NE: return c != 0;
+    case BITPACK_LT: return c < 0;
+    case BITPACK_LE: return c <= 0;
+    case BITPACK_GT: return c > 0;
+    case BITPACK_GE: return c >= 0;
+    }
+    return 0;
+}
+
+static int inline bitview_pred_init(bitview_pred_t* p,
+				    const bitview_layout_t* c,
+				    int k, int op, uint32_t value)
+{
+    const bitview_field_t* g;
+    uint8_t buf[8];
+    uint64_t m;
+    int b;
+
+    if ((k < 0) || (k >= c->nfields) || (op < BITPACK_EQ) || (op > BITPACK_GE))
+	return -1;
+    g = &c->field[k];
+    m = MAKE_MASK64(g->width);
+    b = BIT_OFFSET(g->offset);
+    p->field = k;
+    p->op = op;
+    p->value = value;
+    p->byte = g->byte;
+    p->fast = g->fast;
+    // pre-pack mask and constant as they are stored in memory
+    memset(buf, 0, sizeof(buf));
+    if (c->be) set_bits_be(buf, 0xffffffff, b, g->width);
+    else set_bits_le(buf, 0xffffffff, b, g->width);
+    memcpy(&p->nmask, buf, 8);
+    memset(buf, 0, sizeof(buf));
+    if (c->be) set_bits_be(buf, value & m, b, g->width);
+    else set_bits_le(buf, value & m, b, g->width);
+    memcpy(&p->nvalue, buf, 8);
+    // ordered compare, flip the sign bit to compare signed as unsigned
+    p->omask = m << g->shift;
+    p->oflip = g->sign ? ((uint64_t) 1 << (g->width - 1 + g->shift)) : 0;
+    p->ovalue = ((value & m) << g->shift) ^ p->oflip;
+    // a constant the field can not hold compares the same for all values
+    p->always = -1;
+    if (g->sign) {
+	int32_t hi = (int32_t) (m >> 1);
+	if ((int32_t) value > hi)
+	    p->always = bitview_cmp_(op, -1);
+	else if ((int32_t) value < -hi - 1)
+	    p->always = bitview_cmp_(op, 1);
+    }
+    else if (value > m)
+	p->always = bitview_cmp_(op, -1);
+    return 0;
+}
+
+static int inline bitview_test(const bitview_layout_t* c,
+			       const bitview_pred_t* p, const uint8_t* ptr)
+{
+    if (p->always >= 0)
+	return p->always;
+    if (p->fast) {
+	uint64_t w;
+	if (p->op <= BITPACK_NE) {
+	    memcpy(&w, ptr + p->byte, 8);
+	    return ((w & p->nmask) == p->nvalue) == (p->op == BITPACK_EQ);
+	}
+	w = c->be ? load_be64(ptr + p->byte) : load_le64(ptr + p->byte);
+	w = (w & p->omask) ^ p->oflip;
+	return bitview_cmp_(p->op, (w > p->ovalue) - (w < p->ovalue));
+    }
+    else {
+	uint32_t v = bitview_decode(c, ptr, p->field);
+	if (c->field[p->field].sign)
+	    return bitview_cmp_(p->op, ((int32_t) v > (int32_t) p->value) -
+				((int32_t) v < (int32_t) p->value));
+	return bitview_cmp_(p->op, (v > p->value) - (v < p->value));
+    }
+}
+
+// all n predicates true, stop at the first false
+static int inline bitview_match(const bitview_layout_t* c,
+				const bitview_pred_t* p, int n,
+				const uint8_t* ptr)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+	if (!bitview_test(c, &p[i], ptr))
+	    return 0;
+    }
+    return 1;
+}
+
+#endif